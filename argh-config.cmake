@@ -9,6 +9,8 @@
 
 
 if(NOT TARGET argh)
+  include(CMakeFindDependencyMacro)
+  find_dependency(Threads)
   include("${CMAKE_CURRENT_LIST_DIR}/arghTargets.cmake")
   get_target_property(argh_INCLUDE_DIR argh INTERFACE_INCLUDE_DIRECTORIES)
 endif()
@@ -1,296 +1,2836 @@
 #include "argh.h"
 
+#include <atomic>
+#include <clocale>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <ostream>
+#include <thread>
+#include <type_traits>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ARGH_POSIX_FILES 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+#endif
+
+#if !defined(ARGH_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define ARGH_SSE2 1
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+// AVX2 is compiled in per function and picked at run time, which needs the target attribute
+// (gcc 4.9, clang 3.8)
+#if (defined(__clang__) && (__clang_major__ > 3 || (3 == __clang_major__ && __clang_minor__ >= 8))) || \
+    (!defined(__clang__) && defined(__GNUC__) && (__GNUC__ > 4 || (4 == __GNUC__ && __GNUC_MINOR__ >= 9)))
+#define ARGH_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
 namespace argh
 {
-    // Construct with a value.
-    stringstream_proxy::stringstream_proxy(std::string const& value) :
-        stream_(value)
-    {}
+    string_ref string_ref::substr(size_t pos, size_t count) const
+    {
+        assert(pos <= size_);
+        return string_ref(data_ + pos, std::min(count, size_ - pos));
+    }
+
+    size_t string_ref::find(char c, size_t pos) const
+    {
+        if (pos >= size_)
+            return npos;
+        auto found = static_cast<const char*>(std::memchr(data_ + pos, c, size_ - pos));
+        return found ? static_cast<size_t>(found - data_) : npos;
+    }
+
+    size_t string_ref::find_first_not_of(char c, size_t pos) const
+    {
+        for (; pos < size_; ++pos)
+            if (data_[pos] != c)
+                return pos;
+        return npos;
+    }
+
+    int string_ref::compare(string_ref other) const
+    {
+        auto common = std::min(size_, other.size_);
+        auto result = common ? std::memcmp(data_, other.data_, common) : 0;
+        if (0 != result)
+            return result;
+        return size_ < other.size_ ? -1 : (size_ > other.size_ ? 1 : 0);
+    }
+
+    std::ostream& operator<<(std::ostream& os, string_ref str)
+    {
+        return os.write(str.data(), static_cast<std::streamsize>(str.size()));
+    }
+
+//////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    class new_delete : public memory_resource
+    {
+    protected:
+        void* do_allocate(size_t bytes, size_t) override            { return ::operator new(bytes); }
+        void do_deallocate(void* p, size_t, size_t) override        { ::operator delete(p); }
+    };
+
+    // the strictest alignment ::operator new guarantees
+    union max_aligned
+    {
+        long double ld;
+        long long ll;
+        void* p;
+    };
+    const size_t max_alignment = alignof(max_aligned);
+
+    // the first address at or after p that is a multiple of alignment (a power of two)
+    char* align_up(char* p, size_t alignment)
+    {
+        auto address = reinterpret_cast<uintptr_t>(p);
+        return p + ((alignment - address % alignment) % alignment);
+    }
+}
+
+memory_resource* new_delete_resource()
+{
+    static new_delete resource;
+    return &resource;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+monotonic_resource::monotonic_resource(void* buffer, size_t size, memory_resource* upstream) :
+    upstream_(upstream),
+    buffer_(static_cast<char*>(buffer)),
+    buffer_size_(size),
+    next_(buffer_),
+    left_(size),
+    next_block_size_(std::max<size_t>(1024, 2 * size))
+{}
+
+monotonic_resource::~monotonic_resource()
+{
+    release();
+}
+
+void monotonic_resource::release()
+{
+    while (blocks_)
+    {
+        auto next = blocks_->next;
+        upstream_->deallocate(blocks_, blocks_->size, max_alignment);
+        blocks_ = next;
+    }
+    next_ = buffer_;
+    left_ = buffer_size_;
+}
+
+void* monotonic_resource::do_allocate(size_t bytes, size_t alignment)
+{
+    auto p = next_ ? align_up(next_, alignment) : nullptr;
+    if (!p || static_cast<size_t>(p - next_) + bytes > left_)
+    {
+        // blocks grow geometrically, so a long run of allocations takes few trips upstream
+        auto header = (sizeof(block) + max_alignment - 1) / max_alignment * max_alignment;
+        auto size = std::max(next_block_size_, header + bytes + alignment);
+        auto b = static_cast<block*>(upstream_->allocate(size, max_alignment));
+        b->next = blocks_;
+        b->size = size;
+        blocks_ = b;
+        next_block_size_ = 2 * size;
+
+        next_ = reinterpret_cast<char*>(b) + header;
+        left_ = size - header;
+        p = align_up(next_, alignment);
+    }
+    left_ -= static_cast<size_t>(p - next_) + bytes;
+    next_ = p + bytes;
+    return p;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    bool is_space(char c) { return ' ' == c || ('\t' <= c && c <= '\r'); }
+    bool is_digit(char c) { return '0' <= c && c <= '9'; }
+
+    // The characters std::num_get collects for a floating point value (classic locale):
+    // [ws] [sign] digits [. digits] [(e|E) [sign] digits]
+    struct float_scan
+    {
+        const char* first = nullptr;   // start of the number, after any whitespace
+        const char* last = nullptr;    // one past the last collected char
+        bool complete = false;         // has mantissa digits and, if started, exponent digits
+        bool zero = true;              // all mantissa digits are '0'
+        long exponent = 0;             // decimal exponent of the leading significant digit
+    };
+
+    float_scan scan_float(const char* it, const char* end)
+    {
+        // exponents beyond this are out of range for any double, so stop counting there
+        const long exponent_cap = 100000;
+
+        float_scan scan;
+        while (it != end && is_space(*it))
+            ++it;
+        scan.first = it;
+
+        if (it != end && ('+' == *it || '-' == *it))
+            ++it;
+
+        bool found_mantissa = false;
+        long leading = -1;     // exponent of the leading significant digit seen so far
+        long position = 0;     // exponent of the next integer digit relative to the first one
+        for (; it != end && is_digit(*it); ++it)
+        {
+            found_mantissa = true;
+            if (scan.zero && '0' != *it)
+            {
+                scan.zero = false;
+                position = 0;
+            }
+            if (!scan.zero && position < exponent_cap)
+                leading = position++;
+        }
+
+        if (it != end && '.' == *it)
+        {
+            long fraction = 0;
+            for (++it; it != end && is_digit(*it); ++it)
+            {
+                found_mantissa = true;
+                if (fraction > -exponent_cap)
+                    --fraction;
+                if (scan.zero && '0' != *it)
+                {
+                    scan.zero = false;
+                    leading = fraction;
+                }
+            }
+        }
+
+        scan.last = it;
+        scan.complete = found_mantissa;
+        if (!found_mantissa || it == end || ('e' != *it && 'E' != *it))
+        {
+            scan.exponent = leading;
+            return scan;
+        }
+
+        // the exponent marker (and its sign) are collected even when no digits follow
+        ++it;
+        if (it != end && ('+' == *it || '-' == *it))
+            ++it;
+
+        bool negative = '-' == it[-1];
+        long exponent = 0;
+        bool found_exponent = false;
+        for (; it != end && is_digit(*it); ++it)
+        {
+            found_exponent = true;
+            if (exponent < exponent_cap)
+                exponent = exponent * 10 + (*it - '0');
+        }
+
+        scan.last = it;
+        scan.complete = found_exponent;
+        scan.exponent = leading + (negative ? -exponent : exponent);
+        return scan;
+    }
+
+    // run strtod/strtof on [first, last), which must be a complete number as collected by scan_float.
+    // strto* read the decimal point of LC_NUMERIC, so the copy spells the '.' that way, and the
+    // conversion fails unless strto* consumes the whole copy.
+    template <typename T, typename Strto>
+    bool strto_copy(const char* first, const char* last, Strto strto, T& value)
+    {
+        const char* point = std::localeconv()->decimal_point;
+        auto point_size = std::strlen(point);
+        auto dot = std::find(first, last, '.');
+        auto size = static_cast<size_t>(last - first) + (dot != last ? point_size - 1 : 0);
+
+        // strto* needs a NUL terminated copy. numbers rarely need the heap
+        char buffer[64];
+        std::string long_number;
+        char* number = buffer;
+        if (size >= sizeof(buffer))
+        {
+            long_number.resize(size);
+            number = &long_number[0];
+        }
+        char* out = std::copy(first, dot, number);
+        if (dot != last)
+        {
+            out = std::copy(point, point + point_size, out);
+            out = std::copy(dot + 1, last, out);
+        }
+        *out = '\0';
+
+        char* end = nullptr;
+        value = strto(number, &end);
+        return end == out;
+    }
+
+    // true if the collected number converts to an infinite double, which the stream reports as a failure
+    bool overflows(float_scan const& scan)
+    {
+        const long max_exponent = std::numeric_limits<double>::max_exponent10;
+        if (scan.zero || scan.exponent < max_exponent)
+            return false;
+        if (scan.exponent > max_exponent)
+            return true;
+
+        // close to DBL_MAX: let the C library do the rounding
+        double value = 0;
+        return !strto_copy(scan.first, scan.last, std::strtod, value) ||
+               value == std::numeric_limits<double>::infinity() ||
+               value == -std::numeric_limits<double>::infinity();
+    }
+}
+
+bool detail::is_number(string_ref arg)
+{
+    auto scan = scan_float(arg.begin(), arg.end());
+    return scan.complete && !overflows(scan);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    template <typename T>
+    bool convert_integer(string_ref str, T& value)
+    {
+        typedef unsigned long long wide;
+
+        auto it = str.begin();
+        bool negative = false;
+        if (it != str.end() && ('+' == *it || '-' == *it))
+            negative = '-' == *it++;
+        if (it == str.end() || (negative && !std::numeric_limits<T>::is_signed))
+            return false;
+
+        // the magnitude limit: max, or |min| for negative values
+        wide limit = static_cast<wide>(std::numeric_limits<T>::max()) + (negative ? 1 : 0);
+        wide magnitude = 0;
+        for (; it != str.end(); ++it)
+        {
+            if (!is_digit(*it))
+                return false;
+            auto digit = static_cast<wide>(*it - '0');
+            if (magnitude > (limit - digit) / 10)
+                return false;
+            magnitude = magnitude * 10 + digit;
+        }
+
+        // negate in the unsigned domain, so that |min| does not overflow
+        value = negative ? static_cast<T>(0 - magnitude) : static_cast<T>(magnitude);
+        return true;
+    }
+
+    template <typename T>
+    bool is_infinite(T value)
+    {
+        return value == std::numeric_limits<T>::infinity() || value == -std::numeric_limits<T>::infinity();
+    }
+
+    template <typename T, typename Strto>
+    bool convert_float(string_ref str, T& value, Strto strto)
+    {
+        auto scan = scan_float(str.begin(), str.end());
+        if (!scan.complete || scan.first != str.begin() || scan.last != str.end())
+            return false;
+
+        T converted = 0;
+        if (!strto_copy(scan.first, scan.last, strto, converted) || is_infinite(converted))
+            return false;
+        value = converted;
+        return true;
+    }
+
+    // std::num_get integer extraction (base 10): [sign] digits, consuming all digits.
+    // On failure value is 0, on overflow the closest limit, with failbit set in both cases.
+    template <typename T>
+    std::ios_base::iostate scan_integer(const char*& it, const char* end, T& value)
+    {
+        typedef typename std::make_unsigned<T>::type unsigned_type;
+        const bool is_signed = std::numeric_limits<T>::is_signed;
+
+        bool negative = false;
+        if (it != end && ('+' == *it || '-' == *it))
+            negative = '-' == *it++;
+
+        const unsigned_type max = negative && is_signed ? static_cast<unsigned_type>(0 - static_cast<unsigned_type>(std::numeric_limits<T>::min()))
+                                                        : static_cast<unsigned_type>(std::numeric_limits<T>::max());
+        unsigned_type result = 0;
+        bool found_digit = false;
+        bool overflow = false;
+        for (; it != end && is_digit(*it); ++it)
+        {
+            found_digit = true;
+            auto digit = static_cast<unsigned_type>(*it - '0');
+            if (result > max / 10)
+                overflow = true;
+            else
+            {
+                result = static_cast<unsigned_type>(result * 10);
+                overflow |= result > max - digit;
+                result = static_cast<unsigned_type>(result + digit);
+            }
+        }
+
+        std::ios_base::iostate state = it == end ? std::ios_base::eofbit : std::ios_base::goodbit;
+        if (!found_digit)
+        {
+            value = 0;
+            return state | std::ios_base::failbit;
+        }
+        if (overflow)
+        {
+            value = negative && is_signed ? std::numeric_limits<T>::min() : std::numeric_limits<T>::max();
+            return state | std::ios_base::failbit;
+        }
+        // negative unsigned values wrap around, like strtoul
+        value = static_cast<T>(negative ? static_cast<unsigned_type>(0 - result) : result);
+        return state;
+    }
+}
+
+bool detail::convert(string_ref str, bool& value)
+{
+    if (1 != str.size() || ('0' != str[0] && '1' != str[0]))
+        return false;
+    value = '1' == str[0];
+    return true;
+}
+
+bool detail::convert(string_ref str, char& value)
+{
+    if (1 != str.size())
+        return false;
+    value = str[0];
+    return true;
+}
+
+bool detail::convert(string_ref str, unsigned char& value)
+{
+    if (1 != str.size())
+        return false;
+    value = static_cast<unsigned char>(str[0]);
+    return true;
+}
+
+bool detail::convert(string_ref str, short& value)              { return convert_integer(str, value); }
+bool detail::convert(string_ref str, int& value)                { return convert_integer(str, value); }
+bool detail::convert(string_ref str, long& value)               { return convert_integer(str, value); }
+bool detail::convert(string_ref str, long long& value)          { return convert_integer(str, value); }
+bool detail::convert(string_ref str, unsigned short& value)     { return convert_integer(str, value); }
+bool detail::convert(string_ref str, unsigned int& value)       { return convert_integer(str, value); }
+bool detail::convert(string_ref str, unsigned long& value)      { return convert_integer(str, value); }
+bool detail::convert(string_ref str, unsigned long long& value) { return convert_integer(str, value); }
+bool detail::convert(string_ref str, float& value)              { return convert_float(str, value, std::strtof); }
+bool detail::convert(string_ref str, double& value)             { return convert_float(str, value, std::strtod); }
+
+bool detail::convert(string_ref str, std::string& value)
+{
+    value.assign(str.data(), str.size());
+    return true;
+}
+
+bool detail::convert(string_ref str, string_ref& value)
+{
+    value = str;
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+    // Construct with a value.
+    stringstream_proxy::stringstream_proxy(std::string const& value) :
+        owned_(value),
+        str_(owned_)
+    {}
+
+    stringstream_proxy stringstream_proxy::view(string_ref value)
+    {
+        stringstream_proxy proxy;
+        proxy.str_ = value;
+        return proxy;
+    }
+
+    // Copy constructor. Like copying the underlying stream's string and state, reading restarts at the beginning.
+    stringstream_proxy::stringstream_proxy(const stringstream_proxy& other) :
+        owned_(other.owned_),
+        str_(other.str_.data() == other.owned_.data() ? string_ref(owned_) : other.str_),
+        state_(other.state_)
+    {}
+
+    stringstream_proxy& stringstream_proxy::operator=(const stringstream_proxy& other) {
+        if (this != &other) {
+            owned_ = other.owned_;
+            str_ = other.str_.data() == other.owned_.data() ? string_ref(owned_) : other.str_;
+            pos_ = 0;
+            state_ = other.state_;
+        }
+        return *this;
+    }
+
+    void stringstream_proxy::setstate(std::ios_base::iostate state) { state_ |= state; }
+
+    // Get the string value.
+    std::string stringstream_proxy::str() const { return str_.str(); }
+
+    // Check the state of the stream.
+    // False when the most recent stream operation failed
+    stringstream_proxy::operator bool() const { return !(state_ & (std::ios_base::failbit | std::ios_base::badbit)); }
+
+    bool stringstream_proxy::sentry()
+    {
+        if (std::ios_base::goodbit == state_)
+        {
+            while (pos_ < str_.size() && is_space(str_[pos_]))
+                ++pos_;
+            if (pos_ < str_.size())
+                return true;
+            state_ |= std::ios_base::eofbit;
+        }
+        state_ |= std::ios_base::failbit;
+        return false;
+    }
+
+    template <typename T>
+    stringstream_proxy& stringstream_proxy::extract_integer(T& value)
+    {
+        if (sentry())
+        {
+            auto it = str_.data() + pos_;
+            state_ |= scan_integer(it, str_.data() + str_.size(), value);
+            pos_ = static_cast<size_t>(it - str_.data());
+        }
+        return *this;
+    }
+
+    // short and int are read as long and then range checked, as std::istream does
+    template <typename T>
+    stringstream_proxy& stringstream_proxy::extract_clamped(T& value)
+    {
+        long wide = 0;
+        if (sentry())
+        {
+            auto it = str_.data() + pos_;
+            state_ |= scan_integer(it, str_.data() + str_.size(), wide);
+            pos_ = static_cast<size_t>(it - str_.data());
+
+            if (wide < std::numeric_limits<T>::min())
+            {
+                state_ |= std::ios_base::failbit;
+                value = std::numeric_limits<T>::min();
+            }
+            else if (wide > std::numeric_limits<T>::max())
+            {
+                state_ |= std::ios_base::failbit;
+                value = std::numeric_limits<T>::max();
+            }
+            else
+                value = static_cast<T>(wide);
+        }
+        return *this;
+    }
+
+    template <typename T, typename Strto>
+    stringstream_proxy& stringstream_proxy::extract_float(T& value, Strto strto)
+    {
+        if (sentry())
+        {
+            auto end = str_.data() + str_.size();
+            auto scan = scan_float(str_.data() + pos_, end);
+            pos_ = static_cast<size_t>(scan.last - str_.data());
+            if (scan.last == end)
+                state_ |= std::ios_base::eofbit;
+
+            if (!scan.complete)
+            {
+                value = 0;
+                state_ |= std::ios_base::failbit;
+            }
+            else
+            {
+                if (!strto_copy(scan.first, scan.last, strto, value))
+                {
+                    value = 0;
+                    state_ |= std::ios_base::failbit;
+                }
+                else if (is_infinite(value))
+                {
+                    value = value < 0 ? -std::numeric_limits<T>::max() : std::numeric_limits<T>::max();
+                    state_ |= std::ios_base::failbit;
+                }
+            }
+        }
+        return *this;
+    }
+
+    stringstream_proxy& stringstream_proxy::operator>>(bool& value)
+    {
+        if (sentry())
+        {
+            auto it = str_.data() + pos_;
+            auto end = str_.data() + str_.size();
+            long number = -1;
+            auto state = scan_integer(it, end, number);
+            pos_ = static_cast<size_t>(it - str_.data());
+            if (0 == number || 1 == number)
+                value = 1 == number;
+            else
+            {
+                value = true;
+                state = std::ios_base::failbit | (it == end ? std::ios_base::eofbit : std::ios_base::goodbit);
+            }
+            state_ |= state;
+        }
+        return *this;
+    }
+
+    stringstream_proxy& stringstream_proxy::operator>>(char*& value)
+    {
+        if (sentry())
+        {
+            auto out = value;
+            for (; pos_ < str_.size() && !is_space(str_[pos_]); ++pos_)
+                *out++ = str_[pos_];
+            *out = '\0';
+            if (pos_ == str_.size())
+                state_ |= std::ios_base::eofbit;
+        }
+        return *this;
+    }
+
+    stringstream_proxy& stringstream_proxy::operator>>(std::string& value)
+    {
+        if (sentry())
+        {
+            auto first = pos_;
+            while (pos_ < str_.size() && !is_space(str_[pos_]))
+                ++pos_;
+            value.assign(str_.data() + first, pos_ - first);
+            if (pos_ == str_.size())
+                state_ |= std::ios_base::eofbit;
+        }
+        return *this;
+    }
+
+    stringstream_proxy& stringstream_proxy::operator>>(char& value)
+    {
+        if (sentry())
+            value = str_[pos_++];
+        return *this;
+    }
+
+    stringstream_proxy& stringstream_proxy::operator>>(unsigned char& value)
+    {
+        if (sentry())
+            value = static_cast<unsigned char>(str_[pos_++]);
+        return *this;
+    }
+
+    stringstream_proxy& stringstream_proxy::operator>>(double& value) { return extract_float(value, std::strtod); }
+    stringstream_proxy& stringstream_proxy::operator>>(float& value) { return extract_float(value, std::strtof); }
+    stringstream_proxy& stringstream_proxy::operator>>(short& value) { return extract_clamped(value); }
+    stringstream_proxy& stringstream_proxy::operator>>(int& value) { return extract_clamped(value); }
+    stringstream_proxy& stringstream_proxy::operator>>(long& value) { return extract_integer(value); }
+    stringstream_proxy& stringstream_proxy::operator>>(long long& value) { return extract_integer(value); }
+    stringstream_proxy& stringstream_proxy::operator>>(unsigned short& value) { return extract_integer(value); }
+    stringstream_proxy& stringstream_proxy::operator>>(unsigned int& value) { return extract_integer(value); }
+    stringstream_proxy& stringstream_proxy::operator>>(unsigned long& value) { return extract_integer(value); }
+    stringstream_proxy& stringstream_proxy::operator>>(unsigned long long& value) { return extract_integer(value); }
+
+//////////////////////////////////////////////////////////////////////////
+
+size_t detail::name_index::capacity_for(size_t count)
+{
+    size_t capacity = 8;
+    while (capacity < 2 * count)
+        capacity *= 2;
+    return capacity;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void detail::name_index::reset(size_t count)
+{
+    slots_.assign(capacity_for(count), slot{ 0, 0 });
+    size_ = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void detail::name_index::reserve(size_t count)
+{
+    auto capacity = capacity_for(count);
+    if (capacity > slots_.size())
+        rehash(capacity);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void detail::name_index::rehash(size_t capacity)
+{
+    vector<slot> old(capacity, slot{ 0, 0 }, slots_.get_allocator());
+    old.swap(slots_);
+
+    auto mask = slots_.size() - 1;
+    for (auto const& s : old)
+    {
+        if (0 == s.pos)
+            continue;
+        auto i = s.hash & mask;
+        while (0 != slots_[i].pos)
+            i = (i + 1) & mask;
+        slots_[i] = s;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    // What the first pass of parse_args finds out about an arg, for the second pass to build the results from.
+    struct token
+    {
+        size_t dashes;      // leading dashes, 0 for an arg of only dashes (see trim_leading_dashes)
+        size_t equal;       // offset of the first '=' after the dashes, or string_ref::npos
+        bool option;
+    };
+
+    // parse_args classifies this many args at a time into a buffer on the stack
+    const size_t token_block = 256;
+
+    void classify_tokens(string_ref const* args, size_t count, bool split_on_equal, token* tokens)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            auto arg = args[i];
+            auto& t = tokens[i];
+
+            // only an arg starting with '-' can be an option, so only those go through is_number
+            t.option = !arg.empty() && '-' == arg[0] && !detail::is_number(arg);
+            t.dashes = 0;
+            t.equal = string_ref::npos;
+            if (!t.option)
+                continue;
+
+            auto dashes = arg.find_first_not_of('-');
+            if (string_ref::npos == dashes)
+                continue;
+            t.dashes = dashes;
+            if (split_on_equal)
+            {
+                t.equal = arg.find('=', dashes);
+                if (string_ref::npos != t.equal)
+                    t.equal -= dashes;
+            }
+        }
+    }
+
+    string_stream bad_stream()
+    {
+        string_stream bad;
+        bad.setstate(std::ios_base::failbit);
+        return bad;
+    }
+
+    // a copy of a view stream that owns its characters, so that it may outlive the parse
+    string_stream owned(string_stream const& view)
+    {
+        return view ? string_stream(view.str()) : bad_stream();
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+bool detail::name_set::insert(string_ref name)
+{
+    auto pos = static_cast<uint32_t>(ends_.size());
+    if (!index_.insert(name, pos, [this](uint32_t p) { return name_at(p); }))
+        return false;
+    chars_.insert(chars_.end(), name.begin(), name.end());
+    ends_.push_back(static_cast<uint32_t>(chars_.size()));
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+bool detail::name_set::contains(string_ref name) const
+{
+    return name_index::npos != find(name, hash(name));
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+uint32_t detail::name_set::find(string_ref name, uint32_t h) const
+{
+    return index_.find_hashed(h, [&](uint32_t p) { return name_at(p) == name; });
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void detail::name_set::reserve(size_t count, size_t chars)
+{
+    // keep growing geometrically, so that many small bulk inserts stay linear
+    auto grow = [](size_t capacity, size_t needed) { return std::max(needed, 2 * capacity); };
+    if (chars_.size() + chars > chars_.capacity())
+        chars_.reserve(grow(chars_.capacity(), chars_.size() + chars));
+    if (ends_.size() + count > ends_.capacity())
+        ends_.reserve(grow(ends_.capacity(), ends_.size() + count));
+    index_.reserve(ends_.size() + count);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+string_ref detail::name_set::name_at(uint32_t pos) const
+{
+    auto first = 0 == pos ? 0 : ends_[pos - 1];
+    return string_ref(chars_.data() + first, ends_[pos] - first);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void detail::string_cache::reset(size_t count)
+{
+    allocator<std::string> alloc(slots_.get_allocator());
+    for (auto& slot : slots_)
+    {
+        if (auto str = slot.load(std::memory_order_relaxed))
+        {
+            str->~basic_string();
+            alloc.deallocate(str, 1);
+            slot.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    // the slots only grow (geometrically), so that re-parsing soon allocates none
+    if (count > slots_.size())
+    {
+        vector<std::atomic<std::string*>> slots(std::max(count, 2 * slots_.size()), slots_.get_allocator());
+        slots_.swap(slots);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+std::string const& detail::string_cache::get(size_t ind, string_ref view) const
+{
+    auto& slot = slots_[ind];
+    auto str = slot.load(std::memory_order_acquire);
+    if (str)
+        return *str;
+
+    // the characters are copied first, so that nothing leaks if either allocation throws
+    std::string copy(view.data(), view.size());
+    allocator<std::string> alloc(slots_.get_allocator());
+    auto built = new (alloc.allocate(1)) std::string(std::move(copy));
+
+    // another thread may have published its copy meanwhile
+    if (slot.compare_exchange_strong(str, built, std::memory_order_acq_rel, std::memory_order_acquire))
+        return *built;
+    built->~basic_string();
+    alloc.deallocate(built, 1);
+    return *str;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void detail::char_flags::clear()
+{
+    for (unsigned word = 0; word < 4; ++word)
+    {
+        unsigned c = word * 64;
+        for (auto bits = bits_[word]; bits; bits >>= 1, ++c)
+        {
+            if (bits & 1)
+                counts_[c] = 0;
+        }
+        bits_[word] = 0;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+detail::prefix_index::prefix_index(name_set const& registered, schema const* options, memory_resource* resource)
+    : chars_(resource)
+    , names_(resource)
+    , registered_(registered.size())
+{
+    auto add = [this](string_ref name, uint32_t id)
+    {
+        names_.push_back({ static_cast<uint32_t>(chars_.size()), static_cast<uint32_t>(name.size()), id, 0 });
+        chars_.insert(chars_.end(), name.begin(), name.end());
+    };
+
+    uint32_t ids = 0;
+    if (options)
+    {
+        for (size_t i = 0; i < options->spelling_count(); ++i)
+            add(options->spelling(i), options->spelling_id(i));
+        ids = static_cast<uint32_t>(options->size());
+    }
+    for (uint32_t i = 0; i < registered.size(); ++i)
+    {
+        auto name = registered.name_at(i);
+        if (!options || schema::npos == options->find(name))
+            add(name, ids++);
+    }
+
+    std::sort(names_.begin(), names_.end(), [this](entry const& lhs, entry const& rhs)
+    {
+        return name_of(lhs).compare(name_of(rhs)) < 0;
+    });
+
+    for (auto i = names_.size(); i-- > 0; )
+    {
+        names_[i].run_end = i + 1 < names_.size() && names_[i + 1].id == names_[i].id
+                          ? names_[i + 1].run_end
+                          : static_cast<uint32_t>(i) + 1;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+const size_t detail::prefix_index::min_prefix;
+
+detail::prefix_index::match detail::prefix_index::expand(string_ref& name) const
+{
+    if (name.size() < min_prefix)
+        return none;
+
+    // the names starting with name sort right from where name would, up to the first that does not
+    auto first = std::lower_bound(names_.begin(), names_.end(), name, [this](entry const& e, string_ref n)
+    {
+        return name_of(e).compare(n) < 0;
+    });
+    auto last = std::partition_point(first, names_.end(), [&](entry const& e)
+    {
+        return e.size >= name.size() && 0 == std::memcmp(chars_.data() + e.offset, name.data(), name.size());
+    });
+    if (first == last)
+        return none;
+
+    // a known name sorts first, and wins over the longer ones
+    if (first->size != name.size() && first->run_end < static_cast<size_t>(last - names_.begin()))
+        return ambiguous;
+
+    name = name_of(*first);
+    return unique;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+string_ref detail::trim_leading_dashes(string_ref name)
+{
+    auto pos = name.find_first_not_of('-');
+    return string_ref::npos != pos ? name.substr(pos) : name;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    // storage, or a new buffer in its place when other owners share it
+    detail::vector<char>& unshared(std::shared_ptr<detail::vector<char>>& storage, memory_resource* resource)
+    {
+        if (!storage || 1 != storage.use_count())
+        {
+            allocator<char> alloc(resource);
+            storage = std::allocate_shared<detail::vector<char>>(alloc, alloc);
+        }
+        return *storage;
+    }
+
+    // bulk registration: size the set's arena and hash table once for all the names, then insert
+    void register_params(detail::name_set& registered, std::vector<std::string> const& names)
+    {
+        size_t chars = 0;
+        for (auto& name : names)
+            chars += name.size();
+        registered.reserve(names.size(), chars);
+
+        for (auto& name : names)
+            registered.insert(detail::trim_leading_dashes(name));
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void detail::copy_args(string_ref* first, string_ref* last, std::shared_ptr<vector<char>>& storage, memory_resource* resource)
+{
+    size_t total = 0;
+    for (auto arg = first; arg != last; ++arg)
+        total += arg->size() + 1;
+
+    unshared(storage, resource).resize(total);
+
+    auto out = storage->data();
+    for (auto arg = first; arg != last; ++arg)
+    {
+        std::memcpy(out, arg->data(), arg->size());
+        out[arg->size()] = '\0';
+        *arg = string_ref(out, arg->size());
+        out += arg->size() + 1;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    // The tokenizers read [it, end) and write the words from out on, appending them to args.
+    // Unquoting only ever drops characters, and each word's NUL takes the place of the blank after it
+    // (but for the last word, which gets one only if out has not reached out_end). So the words always fit
+    // in one more byte than the input, and out never overtakes it: the input may be tokenized in place.
+
+    // the reference tokenizer, a byte at a time
+    void tokenize_scalar(const char* it, const char* end, char* out, char* out_end, detail::vector<string_ref>& args)
+    {
+        for (;;)
+        {
+            while (it != end && (is_space(*it) || ('\\' == *it && it + 1 != end && '\n' == it[1])))
+                it += is_space(*it) ? 1 : 2;
+            if (it == end)
+                break;
+
+            auto word = out;
+            while (it != end && !is_space(*it))
+            {
+                auto c = *it++;
+                if ('\'' == c)
+                {
+                    while (it != end && '\'' != *it)
+                        *out++ = *it++;
+                    if (it != end)
+                        ++it;
+                }
+                else if ('"' == c)
+                {
+                    while (it != end && '"' != *it)
+                    {
+                        if ('\\' == *it && it + 1 != end && '\0' != it[1] && std::strchr("\"\\$`\n", it[1]))
+                        {
+                            ++it; // drop the backslash
+                            if ('\n' == *it)
+                            {
+                                ++it;
+                                continue;
+                            }
+                        }
+                        *out++ = *it++;
+                    }
+                    if (it != end)
+                        ++it;
+                }
+                else if ('\\' == c && it != end)
+                {
+                    if ('\n' != *it)
+                        *out++ = *it;
+                    ++it;
+                }
+                else
+                    *out++ = c;
+            }
+            args.emplace_back(word, static_cast<size_t>(out - word));
+            if (it != end)
+                ++it; // the blank, read before out may overwrite it
+            if (out != out_end)
+                *out++ = '\0';
+        }
+    }
+
+    // the characters a backslash escapes inside double quotes
+    bool is_dquote_escape(char c) { return '"' == c || '\\' == c || '$' == c || '`' == c || '\n' == c; }
+
+    // in a word outside quotes, a run of ordinary characters ends at a blank, a quote or a backslash
+    bool ends_unquoted_run(char c) { return is_space(c) || '\'' == c || '"' == c || '\\' == c; }
+    bool ends_dquoted_run(char c)  { return '"' == c || '\\' == c; }
+
+    struct scalar_scan
+    {
+        static const char* unquoted(const char* it, const char* end)
+        {
+            while (it != end && !ends_unquoted_run(*it))
+                ++it;
+            return it;
+        }
+
+        static const char* dquoted(const char* it, const char* end)
+        {
+            while (it != end && !ends_dquoted_run(*it))
+                ++it;
+            return it;
+        }
+    };
+
+    const char* copy_run(const char* first, const char* last, char*& out)
+    {
+        if (out != first) // in place, the run is often already where it belongs
+            std::memmove(out, first, static_cast<size_t>(last - first));
+        out += last - first;
+        return last;
+    }
+
+    // the same words as tokenize_scalar, with the ordinary characters found and copied a run at a time
+    template <typename Scan>
+    void tokenize_runs(const char* it, const char* end, char* out, char* out_end, detail::vector<string_ref>& args)
+    {
+        for (;;)
+        {
+            while (it != end && (is_space(*it) || ('\\' == *it && it + 1 != end && '\n' == it[1])))
+                it += is_space(*it) ? 1 : 2;
+            if (it == end)
+                break;
+
+            auto word = out;
+            for (;;)
+            {
+                it = copy_run(it, Scan::unquoted(it, end), out);
+                if (it == end || is_space(*it))
+                    break;
+
+                auto c = *it++;
+                if ('\'' == c)
+                {
+                    auto close = static_cast<const char*>(std::memchr(it, '\'', static_cast<size_t>(end - it)));
+                    it = copy_run(it, close ? close : end, out);
+                    if (it != end)
+                        ++it;
+                }
+                else if ('"' == c)
+                {
+                    for (;;)
+                    {
+                        it = copy_run(it, Scan::dquoted(it, end), out);
+                        if (it == end)
+                            break;
+                        if ('"' == *it)
+                        {
+                            ++it;
+                            break;
+                        }
+                        if (it + 1 != end && is_dquote_escape(it[1]))
+                        {
+                            ++it; // drop the backslash
+                            if ('\n' == *it)
+                            {
+                                ++it;
+                                continue;
+                            }
+                        }
+                        *out++ = *it++;
+                    }
+                }
+                else if (it != end) // a backslash
+                {
+                    if ('\n' != *it)
+                        *out++ = *it;
+                    ++it;
+                }
+                else
+                    *out++ = c;
+            }
+            args.emplace_back(word, static_cast<size_t>(out - word));
+            if (it != end)
+                ++it; // the blank, read before out may overwrite it
+            if (out != out_end)
+                *out++ = '\0';
+        }
+    }
+
+#if ARGH_SSE2
+    unsigned first_bit(unsigned mask)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return index;
+#else
+        return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+    }
+
+    struct sse2_scan
+    {
+        static const char* unquoted(const char* it, const char* end)
+        {
+            for (; end - it >= 16; it += 16)
+            {
+                auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(it));
+                // \t..\r are the blanks below ' ': block - '\t' <= 4, unsigned
+                auto control = _mm_sub_epi8(block, _mm_set1_epi8('\t'));
+                auto special = _mm_cmpeq_epi8(_mm_min_epu8(control, _mm_set1_epi8(4)), control);
+                special = _mm_or_si128(special, _mm_cmpeq_epi8(block, _mm_set1_epi8(' ')));
+                special = _mm_or_si128(special, _mm_cmpeq_epi8(block, _mm_set1_epi8('\'')));
+                special = _mm_or_si128(special, _mm_cmpeq_epi8(block, _mm_set1_epi8('"')));
+                special = _mm_or_si128(special, _mm_cmpeq_epi8(block, _mm_set1_epi8('\\')));
+                auto mask = static_cast<unsigned>(_mm_movemask_epi8(special));
+                if (mask)
+                    return it + first_bit(mask);
+            }
+            return scalar_scan::unquoted(it, end);
+        }
+
+        static const char* dquoted(const char* it, const char* end)
+        {
+            for (; end - it >= 16; it += 16)
+            {
+                auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(it));
+                auto special = _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('"')),
+                                            _mm_cmpeq_epi8(block, _mm_set1_epi8('\\')));
+                auto mask = static_cast<unsigned>(_mm_movemask_epi8(special));
+                if (mask)
+                    return it + first_bit(mask);
+            }
+            return scalar_scan::dquoted(it, end);
+        }
+    };
+#endif
+
+#if ARGH_AVX2
+    struct avx2_scan
+    {
+        __attribute__((target("avx2")))
+        static const char* unquoted(const char* it, const char* end)
+        {
+            for (; end - it >= 32; it += 32)
+            {
+                auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(it));
+                auto control = _mm256_sub_epi8(block, _mm256_set1_epi8('\t'));
+                auto special = _mm256_cmpeq_epi8(_mm256_min_epu8(control, _mm256_set1_epi8(4)), control);
+                special = _mm256_or_si256(special, _mm256_cmpeq_epi8(block, _mm256_set1_epi8(' ')));
+                special = _mm256_or_si256(special, _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\'')));
+                special = _mm256_or_si256(special, _mm256_cmpeq_epi8(block, _mm256_set1_epi8('"')));
+                special = _mm256_or_si256(special, _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\\')));
+                auto mask = static_cast<unsigned>(_mm256_movemask_epi8(special));
+                if (mask)
+                    return it + first_bit(mask);
+            }
+            return sse2_scan::unquoted(it, end);
+        }
+
+        __attribute__((target("avx2")))
+        static const char* dquoted(const char* it, const char* end)
+        {
+            for (; end - it >= 32; it += 32)
+            {
+                auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(it));
+                auto special = _mm256_or_si256(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('"')),
+                                               _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\\')));
+                auto mask = static_cast<unsigned>(_mm256_movemask_epi8(special));
+                if (mask)
+                    return it + first_bit(mask);
+            }
+            return sse2_scan::dquoted(it, end);
+        }
+    };
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+detail::scanner detail::best_scanner()
+{
+#if ARGH_AVX2
+    static const bool avx2 = (__builtin_cpu_init(), __builtin_cpu_supports("avx2"));
+    if (avx2)
+        return scanner::avx2;
+#endif
+#if ARGH_SSE2
+    return scanner::sse2;
+#else
+    return scanner::scalar;
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    void tokenize_with(detail::scanner scan, const char* first, const char* last, char* out, char* out_end,
+                       detail::vector<string_ref>& args)
+    {
+        switch (std::min(scan, detail::best_scanner()))
+        {
+#if ARGH_AVX2
+        case detail::scanner::avx2: return tokenize_runs<avx2_scan>(first, last, out, out_end, args);
+#endif
+#if ARGH_SSE2
+        case detail::scanner::sse2: return tokenize_runs<sse2_scan>(first, last, out, out_end, args);
+#endif
+        default:                    return tokenize_scalar(first, last, out, out_end, args);
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void detail::tokenize(string_ref command_line, vector<string_ref>& args, vector<char>& buffer, scanner scan)
+{
+    args.clear();
+    buffer.resize(command_line.size() + 1);
+    tokenize_with(scan, command_line.begin(), command_line.end(), buffer.data(), buffer.data() + buffer.size(), args);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void detail::tokenize_in_place(char* first, char* last, vector<string_ref>& args, scanner scan)
+{
+    tokenize_with(scan, first, last, first, last, args);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+detail::mapped_file::mapped_file(const char* path)
+{
+#if ARGH_POSIX_FILES
+    auto fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+
+    struct stat st;
+    if (0 == ::fstat(fd, &st))
+    {
+        id_ = std::to_string(st.st_dev) + ':' + std::to_string(st.st_ino);
+        if (S_ISREG(st.st_mode))
+        {
+            size_ = static_cast<size_t>(st.st_size);
+            auto p = 0 == size_ ? nullptr : ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            mapped_ = MAP_FAILED != p && nullptr != p;
+            valid_ = mapped_ || 0 == size_;
+            data_ = mapped_ ? static_cast<char*>(p) : nullptr;
+        }
+        else // a pipe or a device: read what it gives
+        {
+            char chunk[4096];
+            ssize_t count;
+            while ((count = ::read(fd, chunk, sizeof(chunk))) > 0)
+                read_.insert(read_.end(), chunk, chunk + count);
+            valid_ = 0 == count;
+        }
+    }
+    ::close(fd);
+#else
+    auto file = std::fopen(path, "rb");
+    if (!file)
+        return;
+
+    id_ = path;
+    char chunk[4096];
+    size_t count;
+    while ((count = std::fread(chunk, 1, sizeof(chunk), file)) > 0)
+        read_.insert(read_.end(), chunk, chunk + count);
+    valid_ = !std::ferror(file);
+    std::fclose(file);
+#endif
+
+    if (!mapped_)
+    {
+        data_ = read_.data();
+        size_ = read_.size();
+    }
+}
+
+detail::mapped_file::mapped_file(mapped_file&& other) noexcept
+{
+    swap(other);
+}
+
+detail::mapped_file& detail::mapped_file::operator=(mapped_file&& other) noexcept
+{
+    mapped_file(std::move(other)).swap(*this);
+    return *this;
+}
+
+detail::mapped_file::~mapped_file()
+{
+#if ARGH_POSIX_FILES
+    if (mapped_)
+        ::munmap(data_, size_);
+#endif
+}
+
+void detail::mapped_file::swap(mapped_file& other) noexcept
+{
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    std::swap(valid_, other.valid_);
+    std::swap(mapped_, other.mapped_);
+    read_.swap(other.read_);    // the contents stay where they are
+    id_.swap(other.id_);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void detail::split_nul_delimited(const char* buffer, size_t size, vector<string_ref>& args)
+{
+    auto end = buffer + size;
+    for (auto it = buffer; it != end; )
+    {
+        auto arg_end = static_cast<const char*>(std::memchr(it, '\0', static_cast<size_t>(end - it)));
+        if (!arg_end)
+            arg_end = end;
+        args.emplace_back(it, static_cast<size_t>(arg_end - it));
+        it = arg_end == end ? end : arg_end + 1;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    // read all of path into buffer, keeping its capacity
+    bool read_file(const char* path, detail::vector<char>& buffer)
+    {
+        auto file = std::fopen(path, "rb");
+        if (!file)
+            return false;
+
+        // /proc files report a size of 0, so read until the end instead of asking
+        size_t size = 0;
+        buffer.resize(std::max<size_t>(buffer.capacity(), 4096));
+        for (;;)
+        {
+            size += std::fread(buffer.data() + size, 1, buffer.size() - size, file);
+            if (size < buffer.size())
+                break;
+            buffer.resize(2 * buffer.size());
+        }
+        auto ok = !std::ferror(file);
+        std::fclose(file);
+        buffer.resize(size);
+        return ok;
+    }
+
+    bool is_response_file(string_ref arg) { return arg.size() > 1 && '@' == arg[0]; }
+
+    // open holds the positions in files of the response files being expanded, outermost first.
+    void expand_into(string_ref const* first, string_ref const* last, detail::vector<string_ref>& out,
+                     detail::vector<detail::mapped_file>& files, detail::vector<size_t>& open)
+    {
+        for (auto arg = first; arg != last; ++arg)
+        {
+            if (!is_response_file(*arg))
+            {
+                out.push_back(*arg);
+                continue;
+            }
+
+            detail::mapped_file file(arg->substr(1).str().c_str());
+            if (!file || std::any_of(open.begin(), open.end(), [&](size_t i) { return files[i].same_file(file); }))
+            {
+                out.push_back(*arg);
+                continue;
+            }
+
+            files.push_back(std::move(file));
+            auto& mapped = files.back();
+            detail::vector<string_ref> words(out.get_allocator());
+            detail::tokenize_in_place(mapped.data(), mapped.data() + mapped.size(), words);
+
+            open.push_back(files.size() - 1);
+            expand_into(words.data(), words.data() + words.size(), out, files, open);
+            open.pop_back();
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void detail::expand_response_files(vector<string_ref>& args, vector<mapped_file>& files)
+{
+    if (args.empty() || std::none_of(args.begin() + 1, args.end(), is_response_file))
+        return;
+
+    vector<string_ref> expanded(1, args[0], args.get_allocator());
+    vector<size_t> open(args.get_allocator());
+    expand_into(args.data() + 1, args.data() + args.size(), expanded, files, open);
+    args.swap(expanded);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+size_t detail::parse_args(string_ref const* args, size_t count, int mode, name_set const& registered,
+                          vector<string_ref>& pos_args,
+                          vector<std::pair<string_ref, string_ref>>& params,
+                          vector<string_ref>& flags,
+                          schema const* options,
+                          prefix_index const* abbreviations,
+                          vector<string_ref>* ambiguous)
+{
+    // what the schema and the registered names know a name as
+    enum class known { nothing, param, flag };
+    auto known_as = [&](string_ref name)
+    {
+        // hashed once for both the schema and the registered names
+        auto h = hash(name);
+        if (options)
+        {
+            auto id = options->find_hashed(name, h);
+            if (schema::npos != id)
+                return options->is_param(id) ? known::param : known::flag;
+        }
+        return name_index::npos != registered.find(name, h) ? known::param : known::nothing;
+    };
+
+    // an abbreviated "--" option takes the name it abbreviates (only long options are abbreviated, as in getopt_long)
+    auto expand = [&](size_t dashes, string_ref name)
+    {
+        if (!abbreviations || dashes < 2)
+            return name;
+        auto full = name;
+        auto match = abbreviations->expand(full);
+        if (prefix_index::ambiguous == match && ambiguous)
+            ambiguous->push_back(name);
+        return prefix_index::unique == match ? full : name;
+    };
+
+    // Two passes over each block of args: the first classifies them all (one tight loop, with a single
+    // is_option test per arg), the second builds the results, looking the next arg's kind up.
+    // A block never reaches past a stopping point, as what follows it is left untouched: it ends at a
+    // "--" with STOP_AT_DOUBLE_DASH, and holds a single arg with STOP_AT_FIRST_POSITIONAL, where
+    // the stopping point only shows once the args before it are parsed.
+    const string_ref double_dash("--", 2);
+    const size_t block_limit = (mode & STOP_AT_FIRST_POSITIONAL) ? 1 : token_block;
+    token tokens[token_block];
+    size_t block_first = 0;
+    size_t block_size = 0;
+    auto token_at = [&](size_t i)
+    {
+        if (i >= block_first + block_size) // the args only move forward
+        {
+            block_first = i;
+            block_size = std::min(block_limit, count - i);
+            if (mode & STOP_AT_DOUBLE_DASH)
+            {
+                auto stop = std::find(args + i, args + i + block_size, double_dash);
+                block_size = std::min<size_t>(block_size, stop - (args + i) + 1);
+            }
+            classify_tokens(args + i, block_size, !(mode & NO_SPLIT_ON_EQUALSIGN), tokens);
+        }
+        return tokens[i - block_first];
+    };
+
+    // parse line
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto t = token_at(i);
+
+        if (!t.option)
+        {
+            pos_args.emplace_back(args[i]);
+            if ((mode & STOP_AT_FIRST_POSITIONAL) && i > 0)
+                return i + 1;
+            continue;
+        }
+
+        if ((mode & STOP_AT_DOUBLE_DASH) && double_dash == args[i])
+            return i + 1;
+
+        auto name = args[i].substr(t.dashes);
+        auto dashes = t.dashes;
+
+        if (string_ref::npos != t.equal)
+        {
+            params.emplace_back(expand(dashes, name.substr(0, t.equal)), name.substr(t.equal + 1));
+            continue;
+        }
+
+        name = expand(dashes, name);
+
+        // if the option is unregistered and should be a multi-flag
+        if (1 == dashes &&                                  // single dash
+            argh::SINGLE_DASH_IS_MULTIFLAG & mode && // multi-flag mode
+            known::param != known_as(name))                   // not a param
+        {
+            string_ref keep_param;
+
+            if (!name.empty() && known::param == known_as(name.substr(name.size() - 1))) // last char is param
+            {
+                keep_param = name.substr(name.size() - 1);
+                name = name.substr(0, name.size() - 1);
+            }
+
+            for (size_t c = 0; c < name.size(); ++c)
+            {
+                flags.emplace_back(name.substr(c, 1));
+            }
+
+            if (!keep_param.empty())
+            {
+                name = keep_param;
+            }
+            else
+            {
+                continue; // do not consider other options for this arg
+            }
+        }
+
+        // any potential option will get as its value the next arg, unless that arg is an option too
+        // in that case it will be determined a flag.
+        if (i == count - 1 || token_at(i + 1).option)
+        {
+            flags.emplace_back(name);
+            continue;
+        }
+
+        // if 'name' is a pre-registered option, then the next arg cannot be a free parameter to it is skipped
+        // otherwise we have 2 modes:
+        // PREFER_FLAG_FOR_UNREG_OPTION: a non-registered 'name' is determined a flag.
+        //                               The following value (the next arg) will be a free parameter.
+        //
+        // PREFER_PARAM_FOR_UNREG_OPTION: a non-registered 'name' is determined a parameter, the next arg
+        //                                will be the value of that option.
+
+        assert(!(mode & argh::PREFER_FLAG_FOR_UNREG_OPTION)
+               || !(mode & argh::PREFER_PARAM_FOR_UNREG_OPTION));
+
+        // the mode only decides for names nobody declared: a schema flag never takes a value
+        bool preferParam = mode & argh::PREFER_PARAM_FOR_UNREG_OPTION;
+        auto kind = known_as(name);
+
+        if (known::param == kind || (known::nothing == kind && preferParam))
+        {
+            params.emplace_back(name, args[i + 1]);
+            ++i; // skip next value, it is not a free parameter
+            continue;
+        }
+        else
+        {
+            flags.emplace_back(name);
+        }
+    }
+    return count;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+const uint32_t detail::name_index::npos;
+const uint32_t schema::npos;
+
+//////////////////////////////////////////////////////////////////////////
+
+uint32_t schema::slot_of(uint32_t h, uint32_t displacement) const
+{
+    // murmur3 finalizer, so that each displacement scatters the bucket's names anew
+    auto x = h ^ (displacement * 0x9E3779B9u);
+    x ^= x >> 16;
+    x *= 0x85EBCA6Bu;
+    x ^= x >> 13;
+    return x & static_cast<uint32_t>(slots_.size() - 1);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+schema::schema(std::vector<option> const& options)
+{
+    detail::name_set seen;
+    for (size_t id = 0; id < options.size(); ++id)
+    {
+        is_param_.push_back(options[id].is_param);
+        for (auto& name : options[id].names)
+        {
+            auto spelling = detail::trim_leading_dashes(name);
+            if (!seen.insert(spelling))
+                continue;
+            spellings_.push_back(spelling);
+            ids_.push_back(static_cast<uint32_t>(id));
+        }
+    }
+
+    // twice as many slots as spellings and a bucket per two slots keep the displacement search short
+    size_t size = 8;
+    while (size < 2 * spellings_.size())
+        size *= 2;
+    slots_.assign(size, 0);
+    displacements_.assign(size / 2, 0);
+
+    std::vector<uint32_t> hashes;
+    std::vector<std::vector<uint32_t>> buckets(displacements_.size());
+    for (size_t i = 0; i < spellings_.size(); ++i)
+    {
+        hashes.push_back(detail::hash(spellings_[i]));
+        buckets[hashes[i] & (buckets.size() - 1)].push_back(static_cast<uint32_t>(i));
+    }
+
+    // place the fullest buckets first, while the table is still empty
+    std::vector<uint32_t> order(buckets.size());
+    for (size_t b = 0; b < order.size(); ++b)
+        order[b] = static_cast<uint32_t>(b);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t lhs, uint32_t rhs) { return buckets[lhs].size() > buckets[rhs].size(); });
+
+    const uint32_t max_displacement = 1 << 16;
+    std::vector<uint32_t> taken;
+    for (auto b : order)
+    {
+        auto const& members = buckets[b];
+        if (members.empty())
+            break;
+
+        bool placed = false;
+        for (uint32_t d = 0; d < max_displacement && !placed; ++d)
+        {
+            taken.clear();
+            placed = std::all_of(members.begin(), members.end(), [&](uint32_t i)
+            {
+                auto slot = slot_of(hashes[i], d);
+                if (0 != slots_[slot] || std::find(taken.begin(), taken.end(), slot) != taken.end())
+                    return false;
+                taken.push_back(slot);
+                return true;
+            });
+            if (placed)
+            {
+                displacements_[b] = d;
+                for (size_t k = 0; k < members.size(); ++k)
+                    slots_[taken[k]] = members[k] + 1;
+            }
+        }
+
+        // only names with the very same hash can never be told apart
+        if (!placed)
+            overflow_.insert(overflow_.end(), members.begin(), members.end());
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+uint32_t schema::find(string_ref name) const
+{
+    name = detail::trim_leading_dashes(name);
+    return find_hashed(name, detail::hash(name));
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+uint32_t schema::find_hashed(string_ref name, uint32_t h) const
+{
+    auto slot = slots_[slot_of(h, displacements_[h & (displacements_.size() - 1)])];
+    if (0 != slot && name == spellings_[slot - 1])
+        return ids_[slot - 1];
+
+    for (auto i : overflow_)
+    {
+        if (name == spellings_[i])
+            return ids_[i];
+    }
+    return npos;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+parser::parser(memory_resource* resource) :
+    args_(resource),
+    pos_args_(resource),
+    pos_strings_(resource),
+    params_(resource),
+    flags_(resource),
+    params_index_(resource),
+    flags_index_(resource),
+    ambiguous_(resource),
+    registered_(resource),
+    params_by_id_(resource),
+    flags_by_id_(resource),
+    aliases_(resource),
+    alias_groups_(resource),
+    params_by_alias_(resource),
+    flags_by_alias_(resource)
+{}
+
+//////////////////////////////////////////////////////////////////////////
+
+parser::parser(schema const& options, memory_resource* resource) :
+    parser(resource)
+{
+    schema_ = &options;
+    params_by_id_.assign(options.size(), detail::name_index::npos);
+    flags_by_id_.assign(options.size(), detail::name_index::npos);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void parser::parse(const char * const argv[], int mode)
+{
+    int argc = 0;
+    for (auto argvp = argv; *argvp; ++argc, ++argvp);
+    parse(argc, argv, mode);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void parser::parse(int argc, const char* const argv[], int mode /*= PREFER_FLAG_FOR_UNREG_OPTION*/)
+{
+    if(argv != nullptr && argc > 1 && argv[argc - 1] == nullptr)
+        argc--;
+
+    args_.assign(argv, argv + argc);
+    if (!(mode & NO_COPY_ARGV)) // otherwise reference the caller's strings directly
+        detail::copy_args(args_.data(), args_.data() + args_.size(), storage_, resource());
+
+    parse_args(mode);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void parser::parse(string_ref command_line, int mode)
+{
+    detail::tokenize(command_line, args_, unshared(storage_, resource()));
+    parse_args(mode);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void parser::parse_nul_delimited(const char* buffer, size_t size, int mode)
+{
+    args_.clear();
+    detail::split_nul_delimited(buffer, size, args_);
+    if (!(mode & NO_COPY_ARGV))
+        detail::copy_args(args_.data(), args_.data() + args_.size(), storage_, resource());
+
+    parse_args(mode);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+bool parser::parse_cmdline_file(const char* path, int mode)
+{
+    args_.clear();
+    auto& buffer = unshared(storage_, resource());
+    auto ok = read_file(path, buffer);
+    if (ok)
+        detail::split_nul_delimited(buffer.data(), buffer.size(), args_);
+
+    parse_args(mode);
+    return ok;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void parser::parse_args(int mode)
+{
+    // let go of the previous parse's response files, reusing the list unless a copy of the parser shares it
+    if (files_ && 1 == files_.use_count())
+        files_->clear();
+    else
+        files_.reset();
+
+    if (mode & EXPAND_RESPONSE_FILES)
+    {
+        if (!files_)
+        {
+            allocator<detail::mapped_file> alloc(resource());
+            files_ = std::allocate_shared<detail::vector<detail::mapped_file>>(alloc, alloc);
+        }
+        detail::expand_response_files(args_, *files_);
+    }
+
+    abbreviate_ = 0 != (mode & ALLOW_ABBREVIATIONS);
+    if (abbreviate_ && (!abbreviations_ || abbreviations_->registered() != registered_.size()))
+    {
+        allocator<detail::prefix_index> alloc(resource());
+        abbreviations_ = std::allocate_shared<detail::prefix_index>(alloc, registered_, schema_, resource());
+    }
+
+    if (mode & LAZY)
+        return defer(mode);
+
+    cancel();
+    classify(mode);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+namespace
+{
+    // a new generation for a parser whose results, or the way they are looked up, just changed. Shared by
+    // all parsers, so that a handle is never mistaken for one of another parser's.
+    uint64_t next_generation()
+    {
+        static std::atomic<uint64_t> generations{ 0 };
+        return ++generations;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void parser::classify(int mode) const
+{
+    // clear out possible previous parsing remnants
+    flags_.clear();
+    params_.clear();
+    pos_args_.clear();
+    ambiguous_.clear();
+
+    tail_ = detail::parse_args(args_.data(), args_.size(), mode, registered_, pos_args_, params_, flags_, schema_,
+                               abbreviate_ ? abbreviations_.get() : nullptr, &ambiguous_);
+    pos_strings_.reset(pos_args_.size());
+    index_results();
+    generation_ = next_generation();
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void parser::index_results() const
+{
+    // Each name is hashed once, for its own index as well as for its schema option and alias group.
+    // The first occurrence of an option or group, under any spelling, is the one kept.
+    auto keep_first = [](detail::vector<uint32_t>& positions, uint32_t id, uint32_t pos)
+    {
+        if (detail::name_index::npos != id && detail::name_index::npos == positions[id])
+            positions[id] = pos;
+    };
+    auto groups = alias_groups_.empty() ? 0 : alias_groups_.back() + 1;
+
+    params_index_.reset(params_.size());
+    params_by_id_.assign(schema_ ? schema_->size() : 0, detail::name_index::npos);
+    params_by_alias_.assign(groups, detail::name_index::npos);
+    for (size_t i = 0; i < params_.size(); ++i)
+    {
+        auto name = params_[i].first;
+        auto h = detail::hash(name);
+        auto pos = static_cast<uint32_t>(i);
+        params_index_.insert_hashed(h, pos, [&](uint32_t p) { return params_[p].first == name; });
+        if (schema_)
+            keep_first(params_by_id_, schema_->find_hashed(name, h), pos);
+        keep_first(params_by_alias_, alias_group(name, h), pos);
+    }
+
+    flags_index_.reset(flags_.size());
+    flags_by_id_.assign(schema_ ? schema_->size() : 0, detail::name_index::npos);
+    flags_by_alias_.assign(groups, detail::name_index::npos);
+    char_flags_.clear();
+    for (size_t i = 0; i < flags_.size(); ++i)
+    {
+        auto flag = flags_[i];
+        auto pos = static_cast<uint32_t>(i);
+        if (1 == flag.size())
+        {
+            char_flags_.add(flag[0]);
+            if (!schema_ && 0 == groups)
+                continue;
+        }
+
+        auto h = detail::hash(flag);
+        if (1 != flag.size())
+            flags_index_.insert_hashed(h, pos, [&](uint32_t p) { return flags_[p] == flag; });
+        if (schema_)
+            keep_first(flags_by_id_, schema_->find_hashed(flag, h), pos);
+        keep_first(flags_by_alias_, alias_group(flag, h), pos);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+uint32_t parser::alias_group(string_ref name, uint32_t h) const
+{
+    if (alias_groups_.empty())
+        return detail::name_index::npos;
+    auto pos = aliases_.find(name, h);
+    return detail::name_index::npos == pos ? pos : alias_groups_[pos];
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+bool argh::parser::got_flag(string_ref name) const
+{
+    resolve();
+    auto flag = detail::trim_leading_dashes(name);
+    if (1 == flag.size() && alias_groups_.empty())
+        return char_flags_.contains(flag[0]);
+
+    // hashed once for both the alias groups and the flags
+    auto h = detail::hash(flag);
+    auto group = alias_group(flag, h);
+    if (detail::name_index::npos != group)
+        return detail::name_index::npos != flags_by_alias_[group];
+    return 1 == flag.size()
+        ? char_flags_.contains(flag[0])
+        : detail::name_index::npos != flags_index_.find_hashed(h, [&](uint32_t pos) { return flags_[pos] == flag; });
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+bool parser::got_flag(option_name name) const
+{
+    resolve();
+    auto flag = name.name();
+    auto group = alias_group(flag, name.hash());
+    if (detail::name_index::npos != group)
+        return detail::name_index::npos != flags_by_alias_[group];
+    if (1 == flag.size())
+        return char_flags_.contains(flag[0]);
+    return detail::name_index::npos != flags_index_.find_hashed(name.hash(), [&](uint32_t p) { return flags_[p] == flag; });
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+uint32_t parser::find_param(option_name name) const
+{
+    resolve();
+    auto param = name.name();
+    auto group = alias_group(param, name.hash());
+    if (detail::name_index::npos != group)
+        return params_by_alias_[group];
+    return params_index_.find_hashed(name.hash(), [&](uint32_t p) { return params_[p].first == param; });
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+bool parser::operator[](option_name name) const
+{
+    return got_flag(name);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+string_stream parser::view(option_name name) const
+{
+    auto pos = find_param(name);
+    if (detail::name_index::npos == pos)
+        return bad_stream();
+    return string_stream::view(params_[pos].second);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+string_stream parser::operator()(option_name name) const
+{
+    return owned(view(name));
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+uint32_t parser::find_param(option_handle const& h) const
+{
+    resolve();
+    return h.generation_ == generation_ ? h.param_ : find_param(h.name_);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+option_handle parser::handle(string_ref name) const
+{
+    resolve();
+    option_handle h;
+    h.name_ = name.str();
+    h.generation_ = generation_;
+    h.param_ = find_param(name);
+    h.flag_ = got_flag(name);
+    return h;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+option_handle parser::handle(option_name name) const
+{
+    return handle(name.name());
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+bool parser::operator[](option_handle const& h) const
+{
+    resolve();
+    return h.generation_ == generation_ ? h.flag_ : got_flag(h.name_);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+string_stream parser::view(option_handle const& h) const
+{
+    auto pos = find_param(h);
+    if (detail::name_index::npos == pos)
+        return bad_stream();
+    return string_stream::view(params_[pos].second);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+string_stream parser::operator()(option_handle const& h) const
+{
+    return owned(view(h));
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+size_t parser::count(char c) const
+{
+    resolve();
+    return char_flags_.count(c);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+uint32_t parser::find_param(string_ref name) const
+{
+    resolve();
+    auto param = detail::trim_leading_dashes(name);
+
+    // hashed once for both the alias groups and the params
+    auto h = detail::hash(param);
+    auto group = alias_group(param, h);
+    if (detail::name_index::npos != group)
+        return params_by_alias_[group];
+    return params_index_.find_hashed(h, [&](uint32_t pos) { return params_[pos].first == param; });
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+bool parser::operator[](string_ref name) const
+{
+    return got_flag(name);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+bool parser::operator[](option_id id) const
+{
+    resolve();
+    assert(schema_ && id.value() < schema_->size());
+    return detail::name_index::npos != flags_by_id_[id.value()];
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+string_stream parser::view(option_id id) const
+{
+    resolve();
+    assert(schema_ && id.value() < schema_->size());
+    auto pos = params_by_id_[id.value()];
+    if (detail::name_index::npos == pos)
+        return bad_stream();
+    return string_stream::view(params_[pos].second);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+string_stream parser::operator()(option_id id) const
+{
+    return owned(view(id));
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+bool parser::operator[](const std::vector<std::string>& init_list) const
+{
+    return std::any_of(init_list.begin(), init_list.end(), [&](const std::string& name) { return got_flag(name); });
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+bool parser::operator[](std::initializer_list<string_ref> init_list) const
+{
+    return std::any_of(init_list.begin(), init_list.end(), [&](string_ref name) { return got_flag(name); });
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+std::string const& parser::operator[](size_t ind) const
+{
+    static const std::string empty;
+    resolve();
+    if (ind < pos_args_.size())
+        return pos_strings_.get(ind, pos_args_[ind]);
+    return empty;
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+string_ref parser::pos_view(size_t ind) const
+{
+    resolve();
+    if (ind < pos_args_.size())
+        return pos_args_[ind];
+    return string_ref();
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+string_stream parser::view(string_ref name) const
+{
+    auto pos = find_param(name);
+    if (detail::name_index::npos != pos)
+        return string_stream::view(params_[pos].second);
+    return bad_stream();
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+string_stream parser::operator()(string_ref name) const
+{
+    return owned(view(name));
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+string_stream parser::operator()(const std::vector<std::string>& init_list) const
+{
+    auto pos = find_any_param(init_list);
+    if (detail::name_index::npos != pos)
+        return string_stream(params_[pos].second.str());
+    return bad_stream();
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+string_stream parser::view(std::initializer_list<string_ref> init_list) const
+{
+    auto pos = find_any_param(init_list);
+    if (detail::name_index::npos != pos)
+        return string_stream::view(params_[pos].second);
+    return bad_stream();
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+string_stream parser::operator()(std::initializer_list<string_ref> init_list) const
+{
+    return owned(view(init_list));
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+string_stream parser::view(size_t ind) const
+{
+    resolve();
+    if (pos_args_.size() <= ind)
+        return bad_stream();
+
+    return string_stream::view(pos_args_[ind]);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+string_stream parser::operator()(size_t ind) const
+{
+    return owned(view(ind));
+}
 
-    // Copy constructor.
-    stringstream_proxy::stringstream_proxy(const stringstream_proxy& other) :
-        stream_(other.stream_.str())
-    {
-        stream_.setstate(other.stream_.rdstate());
-    }
+//////////////////////////////////////////////////////////////////////////
 
-    stringstream_proxy& stringstream_proxy::operator=(const stringstream_proxy& other) {
-        if (this != &other) {
-            stream_.str(other.stream_.str());
-            stream_.clear(other.stream_.rdstate());
-        }
-        return *this;
-    }
+arg_range parser::tail() const
+{
+    resolve();
+    return arg_range(args_.data() + tail_, args_.data() + args_.size());
+}
 
-    void stringstream_proxy::setstate(std::ios_base::iostate state) { stream_.setstate(state); }
+//////////////////////////////////////////////////////////////////////////
 
-    // Get the string value.
-    std::string stringstream_proxy::str() const { return stream_.str(); }
+arg_range parser::ambiguous() const
+{
+    resolve();
+    return arg_range(ambiguous_.data(), ambiguous_.data() + ambiguous_.size());
+}
 
-    // Check the state of the stream.
-    // False when the most recent stream operation failed
-    stringstream_proxy::operator bool() const { return !!stream_; }
+//////////////////////////////////////////////////////////////////////////
+
+void parser::add_param(std::string const& name)
+{
+    // a pending LAZY parse still classifies with the params registered before it
+    resolve();
+    auto trimmed = detail::trim_leading_dashes(name);
+    registered_.insert(trimmed);
+    register_aliases_of(trimmed);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+void parser::add_param(const std::vector<std::string>& init_list)
+{
+    parser::add_params(init_list);
+}
 
-    stringstream_proxy& stringstream_proxy::operator>>(bool& value) { stream_ >> value; return *this;}
-    stringstream_proxy& stringstream_proxy::operator>>(double& value) { stream_ >> value; return *this;}
-    stringstream_proxy& stringstream_proxy::operator>>(char*& value) { stream_ >> value; return *this;}
-    stringstream_proxy& stringstream_proxy::operator>>(std::string& value) { stream_ >> value; return *this;}
-    stringstream_proxy& stringstream_proxy::operator>>(float& value) { stream_ >> value; return *this;}
-    stringstream_proxy& stringstream_proxy::operator>>(char& value) { stream_ >> value; return *this;}
-    stringstream_proxy& stringstream_proxy::operator>>(short& value) { stream_ >> value; return *this;}
-    stringstream_proxy& stringstream_proxy::operator>>(int& value) { stream_ >> value; return *this;}
-    stringstream_proxy& stringstream_proxy::operator>>(long& value) { stream_ >> value; return *this;}
-    stringstream_proxy& stringstream_proxy::operator>>(long long& value) { stream_ >> value; return *this;}
-    stringstream_proxy& stringstream_proxy::operator>>(unsigned char& value) { stream_ >> value; return *this;}
-    stringstream_proxy& stringstream_proxy::operator>>(unsigned short& value) { stream_ >> value; return *this;}
-    stringstream_proxy& stringstream_proxy::operator>>(unsigned int& value) { stream_ >> value; return *this;}
-    stringstream_proxy& stringstream_proxy::operator>>(unsigned long& value) { stream_ >> value; return *this;}
-    stringstream_proxy& stringstream_proxy::operator>>(unsigned long long& value) { stream_ >> value; return *this;}
+//////////////////////////////////////////////////////////////////////////
 
+void parser::add_params(const std::vector<std::string>& init_list)
+{
+    resolve();
+    register_params(registered_, init_list);
+    for (auto& name : init_list)
+        register_aliases_of(detail::trim_leading_dashes(name));
+}
 
 //////////////////////////////////////////////////////////////////////////
 
-void parser::parse(const char * const argv[], int mode)
+void parser::add_params(const std::string &name)
 {
-    int argc = 0;
-    for (auto argvp = argv; *argvp; ++argc, ++argvp);
-    parse(argc, argv, mode);
+    parser::add_param(name);
 }
 
 //////////////////////////////////////////////////////////////////////////
 
-void parser::parse(int argc, const char* const argv[], int mode /*= PREFER_FLAG_FOR_UNREG_OPTION*/)
+void parser::add_aliases(const std::vector<std::string>& names)
 {
-    // clear out possible previous parsing remnants
-    flags_.clear();
-    params_.clear();
-    pos_args_.clear();
+    // aliases only change how the results are looked up, so the current parse is reindexed rather than reparsed
+    resolve();
+    auto group = alias_groups_.empty() ? 0 : alias_groups_.back() + 1;
+    for (auto& name : names)
+    {
+        if (aliases_.insert(detail::trim_leading_dashes(name)))
+            alias_groups_.push_back(group);
+    }
+    for (auto& name : names)
+    {
+        auto trimmed = detail::trim_leading_dashes(name);
+        if (registered_.contains(trimmed))
+            register_aliases_of(trimmed);
+    }
+    index_results();
 
-    if(argv != nullptr && argc > 1 && argv[argc - 1] == nullptr)
-        argc--;
+    // handles resolved before would miss the new aliases
+    generation_ = next_generation();
+}
 
-    // convert to strings
-    args_.resize(static_cast<decltype(args_)::size_type>(argc));
-    std::transform(argv, argv + argc, args_.begin(), [](const char* const arg) { return arg;  });
+//////////////////////////////////////////////////////////////////////////
 
-    // parse line
-    for (auto i = 0u; i < args_.size(); ++i)
+void parser::register_aliases_of(string_ref param)
+{
+    // parse_args looks a name up once, so every spelling of a param is registered
+    auto group = alias_group(param, detail::hash(param));
+    if (detail::name_index::npos == group)
+        return;
+    for (uint32_t pos = 0; pos < alias_groups_.size(); ++pos)
     {
-        if (!is_option(args_[i]))
-        {
-            pos_args_.emplace_back(args_[i]);
-            continue;
-        }
+        if (group == alias_groups_[pos])
+            registered_.insert(aliases_.name_at(pos));
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+const uint32_t router::npos;
 
-        auto name = trim_leading_dashes(args_[i]);
+router::router(std::vector<command> const& commands)
+    : params_(commands.size())
+    , parsers_(commands.size())
+    , registered_(commands.size(), 0)
+{
+    // build the trie with a map of children per node, then lay it out flat, with each node's edges
+    // sorted by word in one array (std::string orders words like string_ref::compare)
+    std::vector<std::map<std::string, uint32_t>> children(1);
+    std::vector<uint32_t> ids(1, npos);
+    for (size_t id = 0; id < commands.size(); ++id)
+    {
+        params_[id] = commands[id].params;
 
-        if (!(mode & NO_SPLIT_ON_EQUALSIGN))
+        auto& path = commands[id].path;
+        uint32_t at = 0;
+        for (size_t pos = 0; pos < path.size(); )
         {
-            auto equalPos = name.find('=');
-            if (equalPos != std::string::npos)
+            auto end = std::min(path.find(' ', pos), path.size());
+            if (end != pos)
             {
-                params_.insert({ name.substr(0, equalPos), name.substr(equalPos + 1) });
-                continue;
+                auto inserted = children[at].insert(std::make_pair(path.substr(pos, end - pos), static_cast<uint32_t>(children.size())));
+                if (inserted.second)
+                {
+                    children.emplace_back();
+                    ids.push_back(npos);
+                }
+                at = inserted.first->second;
             }
+            pos = end + 1;
         }
+        if (npos == ids[at])
+            ids[at] = static_cast<uint32_t>(id);
+    }
 
-        // if the option is unregistered and should be a multi-flag
-        if (1 == (args_[i].size() - name.size()) &&         // single dash
-            argh::SINGLE_DASH_IS_MULTIFLAG & mode && // multi-flag mode
-            !is_param(name))                                  // unregistered
+    for (size_t n = 0; n < children.size(); ++n)
+    {
+        nodes_.push_back({ static_cast<uint32_t>(edges_.size()), static_cast<uint32_t>(children[n].size()), ids[n] });
+        for (auto& child : children[n])
         {
-            std::string keep_param;
-
-            if (!name.empty() && is_param(std::string(1ul, name.back()))) // last char is param
-            {
-                keep_param += name.back();
-                name.resize(name.size() - 1);
-            }
+            edges_.push_back({ static_cast<uint32_t>(words_.size()), static_cast<uint32_t>(child.first.size()), child.second });
+            words_ += child.first;
+        }
+    }
+}
 
-            for (auto const& c : name)
-            {
-                flags_.emplace(std::string{ c });
-            }
+//////////////////////////////////////////////////////////////////////////
 
-            if (!keep_param.empty())
-            {
-                name = keep_param;
-            }
-            else
-            {
-                continue; // do not consider other options for this arg
-            }
-        }
+uint32_t router::match(const char* const* first, const char* const* last, size_t& words) const
+{
+    auto at = &nodes_[0];
+    auto best = at->command;
+    words = 0;
+    auto word_of = [this](edge const& e) { return string_ref(words_.data() + e.word, e.size); };
+    for (auto arg = first; arg != last; ++arg)
+    {
+        string_ref word(*arg);
+        auto edges_end = edges_.begin() + at->first_edge + at->edge_count;
+        auto found = std::lower_bound(edges_.begin() + at->first_edge, edges_end, word,
+                                      [&](edge const& e, string_ref w) { return word_of(e).compare(w) < 0; });
+        if (found == edges_end || !(word_of(*found) == word))
+            break;
 
-        // any potential option will get as its value the next arg, unless that arg is an option too
-        // in that case it will be determined a flag.
-        if (i == args_.size() - 1 || is_option(args_[i + 1]))
+        at = &nodes_[found->child];
+        if (npos != at->command)
         {
-            flags_.emplace(name);
-            continue;
+            best = at->command;
+            words = static_cast<size_t>(arg - first) + 1;
         }
+    }
+    return best;
+}
 
-        // if 'name' is a pre-registered option, then the next arg cannot be a free parameter to it is skipped
-        // otherwise we have 2 modes:
-        // PREFER_FLAG_FOR_UNREG_OPTION: a non-registered 'name' is determined a flag.
-        //                               The following value (the next arg) will be a free parameter.
-        //
-        // PREFER_PARAM_FOR_UNREG_OPTION: a non-registered 'name' is determined a parameter, the next arg
-        //                                will be the value of that option.
+//////////////////////////////////////////////////////////////////////////
 
-        assert(!(mode & argh::PREFER_FLAG_FOR_UNREG_OPTION)
-               || !(mode & argh::PREFER_PARAM_FOR_UNREG_OPTION));
+uint32_t router::route(const char* const argv[], int mode)
+{
+    int argc = 0;
+    for (auto argvp = argv; *argvp; ++argc, ++argvp);
+    return route(argc, argv, mode);
+}
 
-        bool preferParam = mode & argh::PREFER_PARAM_FOR_UNREG_OPTION;
+//////////////////////////////////////////////////////////////////////////
 
-        if (is_param(name) || preferParam)
-        {
-            params_.insert({ name, args_[i + 1] });
-            ++i; // skip next value, it is not a free parameter
-            continue;
-        }
-        else
-        {
-            flags_.emplace(name);
-        }
+uint32_t router::route(int argc, const char* const argv[], int mode)
+{
+    if (argv != nullptr && argc > 1 && argv[argc - 1] == nullptr)
+        argc--;
+    if (argc < 1)
+        return npos;
+
+    size_t words = 0;
+    auto id = match(argv + 1, argv + argc, words);
+    if (npos == id)
+        return npos;
+
+    auto& cmdl = parsers_[id];
+    if (!registered_[id])
+    {
+        cmdl.add_params(params_[id]);
+        registered_[id] = 1;
     }
+    cmdl.parse(argc - static_cast<int>(words), argv + words, mode);
+    return id;
 }
 
 //////////////////////////////////////////////////////////////////////////
 
-string_stream parser::bad_stream() const
+void batch_parser::add_param(std::string const& name)
 {
-    string_stream bad;
-    bad.setstate(std::ios_base::failbit);
-    return bad;
+    registered_.insert(detail::trim_leading_dashes(name));
 }
 
 //////////////////////////////////////////////////////////////////////////
 
-bool parser::is_number(std::string const& arg) const
+void batch_parser::add_params(const std::vector<std::string>& init_list)
 {
-    // inefficient but simple way to determine if a string is a number (which can start with a '-')
-    std::istringstream istr(arg);
-    double number;
-    istr >> number;
-    return !(istr.fail() || istr.bad());
+    register_params(registered_, init_list);
 }
 
 //////////////////////////////////////////////////////////////////////////
 
-bool parser::is_option(std::string const& arg) const
+void batch_parser::parse(const std::vector<const char* const*>& argvs, int mode)
 {
-    assert(0 != arg.size());
-    if (is_number(arg))
-        return false;
-    return '-' == arg[0];
+    collect_args(argvs, mode);
+    parse_commands(mode);
 }
 
 //////////////////////////////////////////////////////////////////////////
 
-std::string parser::trim_leading_dashes(std::string const& name) const
+void batch_parser::parse_parallel(const std::vector<const char* const*>& argvs, unsigned threads, int mode)
 {
-    auto pos = name.find_first_not_of('-');
-    return std::string::npos != pos ? name.substr(pos) : name;
+    collect_args(argvs, mode);
+    if (0 == threads)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    parse_commands_parallel(mode, threads);
 }
 
 //////////////////////////////////////////////////////////////////////////
 
-bool argh::parser::got_flag(std::string const& name) const
+void batch_parser::collect_args(const std::vector<const char* const*>& argvs, int mode)
 {
-    return flags_.end() != flags_.find(trim_leading_dashes(name));
+    args_.clear();
+    arg_offsets_.assign(1, 0);
+    for (auto argv : argvs)
+    {
+        for (auto arg = argv; arg && *arg; ++arg)
+            args_.emplace_back(*arg);
+        arg_offsets_.push_back(static_cast<uint32_t>(args_.size()));
+    }
+
+    if (!(mode & NO_COPY_ARGV))
+        detail::copy_args(args_.data(), args_.data() + args_.size(), storage_);
 }
 
 //////////////////////////////////////////////////////////////////////////
 
-bool argh::parser::is_param(std::string const& name) const
+void batch_parser::parse_nul_delimited(const char* buffer, size_t size, int mode)
 {
-    return registeredParams_.count(name);
+    args_.clear();
+    arg_offsets_.assign(1, 0);
+
+    auto end = buffer + size;
+    for (auto it = buffer; it != end; )
+    {
+        auto arg_end = static_cast<const char*>(std::memchr(it, '\0', static_cast<size_t>(end - it)));
+        if (!arg_end)
+            arg_end = end;  // the last arg may lack its NUL
+
+        if (arg_end == it)  // an empty arg ends the command line
+            arg_offsets_.push_back(static_cast<uint32_t>(args_.size()));
+        else
+            args_.emplace_back(it, static_cast<size_t>(arg_end - it));
+
+        it = arg_end == end ? end : arg_end + 1;
+    }
+    if (arg_offsets_.back() != args_.size())
+        arg_offsets_.push_back(static_cast<uint32_t>(args_.size()));
+
+    if (!(mode & NO_COPY_ARGV))
+        detail::copy_args(args_.data(), args_.data() + args_.size(), storage_);
+
+    parse_commands(mode);
 }
 
 //////////////////////////////////////////////////////////////////////////
 
-bool parser::operator[](std::string const& name) const
+void batch_parser::parse_commands(int mode)
 {
-    return got_flag(name);
+    pos_args_.clear();
+    params_.clear();
+    flags_.clear();
+    pos_offsets_.assign(1, 0);
+    param_offsets_.assign(1, 0);
+    flag_offsets_.assign(1, 0);
+
+    for (size_t cmd = 0; cmd + 1 < arg_offsets_.size(); ++cmd)
+    {
+        detail::parse_args(args_.data() + arg_offsets_[cmd], arg_offsets_[cmd + 1] - arg_offsets_[cmd], mode,
+                           registered_, pos_args_, params_, flags_);
+        pos_offsets_.push_back(static_cast<uint32_t>(pos_args_.size()));
+        param_offsets_.push_back(static_cast<uint32_t>(params_.size()));
+        flag_offsets_.push_back(static_cast<uint32_t>(flags_.size()));
+    }
+
+    index_results();
 }
 
 //////////////////////////////////////////////////////////////////////////
 
-bool parser::operator[](const std::vector<std::string>& init_list) const
+namespace
 {
-    return std::any_of(init_list.begin(), init_list.end(), [&](const std::string& name) { return got_flag(name); });
+    // A range of chunk indices owned by one worker, packed into one atomic word.
+    // The owner takes chunks from the front, idle workers steal them from the back.
+    class chunk_range
+    {
+    public:
+        void assign(uint32_t first, uint32_t last) { range_.store(pack(first, last)); }
+
+        bool pop_front(uint32_t& chunk)
+        {
+            auto range = range_.load();
+            while (first(range) < last(range))
+            {
+                if (range_.compare_exchange_weak(range, pack(first(range) + 1, last(range))))
+                {
+                    chunk = first(range);
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        bool steal_back(uint32_t& chunk)
+        {
+            auto range = range_.load();
+            while (first(range) < last(range))
+            {
+                if (range_.compare_exchange_weak(range, pack(first(range), last(range) - 1)))
+                {
+                    chunk = last(range) - 1;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    private:
+        static uint64_t pack(uint32_t first, uint32_t last) { return static_cast<uint64_t>(first) << 32 | last; }
+        static uint32_t first(uint64_t range)                { return static_cast<uint32_t>(range >> 32); }
+        static uint32_t last(uint64_t range)                 { return static_cast<uint32_t>(range); }
+
+        std::atomic<uint64_t> range_{ 0 };
+    };
+
+    // the results of a run of consecutive command lines, parsed by one worker
+    struct chunk_result
+    {
+        uint32_t first_command = 0;
+        uint32_t last_command = 0;
+        detail::vector<string_ref> pos_args;
+        detail::vector<std::pair<string_ref, string_ref>> params;
+        detail::vector<string_ref> flags;
+        // per command line: the end of its entries in the vectors above
+        std::vector<uint32_t> pos_ends, param_ends, flag_ends;
+        // where this chunk's entries go in the merged arrays
+        size_t pos_base = 0, param_base = 0, flag_base = 0;
+    };
+
+    // run work(worker) on `threads` threads, the calling thread being one of them
+    template <typename Work>
+    void run_workers(unsigned threads, Work const& work)
+    {
+        std::vector<std::thread> pool;
+        for (unsigned worker = 1; worker < threads; ++worker)
+            pool.emplace_back(work, worker);
+        work(0u);
+        for (auto& thread : pool)
+            thread.join();
+    }
 }
 
 //////////////////////////////////////////////////////////////////////////
 
-std::string const& parser::operator[](size_t ind) const
+void batch_parser::parse_commands_parallel(int mode, unsigned threads)
 {
-    if (ind < pos_args_.size())
-        return pos_args_[ind];
-    return empty_;
+    const size_t commands = size();
+    if (threads < 2 || commands < 2)
+        return parse_commands(mode);
+
+    // cut the command lines into chunks of about the same number of args, several per thread,
+    // so that workers running out of work can steal from others
+    const size_t chunk_args = std::max<size_t>(1, args_.size() / (16 * threads));
+    std::vector<chunk_result> chunks;
+    for (size_t cmd = 0; cmd < commands; )
+    {
+        chunk_result chunk;
+        chunk.first_command = static_cast<uint32_t>(cmd);
+        auto first_arg = arg_offsets_[cmd];
+        while (cmd < commands && (cmd == chunk.first_command || arg_offsets_[cmd] - first_arg < chunk_args))
+            ++cmd;
+        chunk.last_command = static_cast<uint32_t>(cmd);
+        chunks.push_back(std::move(chunk));
+    }
+
+    threads = static_cast<unsigned>(std::min<size_t>(threads, chunks.size()));
+    std::vector<chunk_range> ranges(threads);
+    for (unsigned worker = 0; worker < threads; ++worker)
+        ranges[worker].assign(static_cast<uint32_t>(chunks.size() * worker / threads),
+                              static_cast<uint32_t>(chunks.size() * (worker + 1) / threads));
+
+    auto parse_chunk = [&](uint32_t index)
+    {
+        auto& chunk = chunks[index];
+        for (auto cmd = chunk.first_command; cmd < chunk.last_command; ++cmd)
+        {
+            detail::parse_args(args_.data() + arg_offsets_[cmd], arg_offsets_[cmd + 1] - arg_offsets_[cmd], mode,
+                               registered_, chunk.pos_args, chunk.params, chunk.flags);
+            chunk.pos_ends.push_back(static_cast<uint32_t>(chunk.pos_args.size()));
+            chunk.param_ends.push_back(static_cast<uint32_t>(chunk.params.size()));
+            chunk.flag_ends.push_back(static_cast<uint32_t>(chunk.flags.size()));
+        }
+    };
+
+    run_workers(threads, [&](unsigned self)
+    {
+        uint32_t chunk;
+        for (;;)
+        {
+            if (ranges[self].pop_front(chunk))
+            {
+                parse_chunk(chunk);
+                continue;
+            }
+
+            // chunks are only ever taken, so finding every range empty means all work is handed out
+            bool stolen = false;
+            for (unsigned other = 1; other < threads && !stolen; ++other)
+                stolen = ranges[(self + other) % threads].steal_back(chunk);
+            if (!stolen)
+                return;
+            parse_chunk(chunk);
+        }
+    });
+
+    // lay the chunks out back to back, then let each worker copy its own chunks into place
+    size_t pos_total = 0, param_total = 0, flag_total = 0;
+    for (auto& chunk : chunks)
+    {
+        chunk.pos_base = pos_total;
+        chunk.param_base = param_total;
+        chunk.flag_base = flag_total;
+        pos_total += chunk.pos_args.size();
+        param_total += chunk.params.size();
+        flag_total += chunk.flags.size();
+    }
+
+    pos_args_.resize(pos_total);
+    params_.resize(param_total);
+    flags_.resize(flag_total);
+    pos_offsets_.assign(commands + 1, 0);
+    param_offsets_.assign(commands + 1, 0);
+    flag_offsets_.assign(commands + 1, 0);
+
+    run_workers(threads, [&](unsigned self)
+    {
+        for (size_t index = self; index < chunks.size(); index += threads)
+        {
+            auto const& chunk = chunks[index];
+            std::copy(chunk.pos_args.begin(), chunk.pos_args.end(), pos_args_.begin() + static_cast<std::ptrdiff_t>(chunk.pos_base));
+            std::copy(chunk.params.begin(), chunk.params.end(), params_.begin() + static_cast<std::ptrdiff_t>(chunk.param_base));
+            std::copy(chunk.flags.begin(), chunk.flags.end(), flags_.begin() + static_cast<std::ptrdiff_t>(chunk.flag_base));
+            for (auto cmd = chunk.first_command; cmd < chunk.last_command; ++cmd)
+            {
+                auto local = cmd - chunk.first_command;
+                pos_offsets_[cmd + 1] = static_cast<uint32_t>(chunk.pos_base + chunk.pos_ends[local]);
+                param_offsets_[cmd + 1] = static_cast<uint32_t>(chunk.param_base + chunk.param_ends[local]);
+                flag_offsets_[cmd + 1] = static_cast<uint32_t>(chunk.flag_base + chunk.flag_ends[local]);
+            }
+        }
+    });
+
+    index_results();
 }
 
 //////////////////////////////////////////////////////////////////////////
 
-string_stream parser::operator()(std::string const& name) const
+namespace
 {
-    auto optIt = params_.find(trim_leading_dashes(name));
-    if (params_.end() != optIt)
-        return string_stream(optIt->second);
-    return bad_stream();
+    uint32_t command_hash(size_t cmd, string_ref name)
+    {
+        return detail::hash(name) ^ (static_cast<uint32_t>(cmd) * 0x9E3779B1u);
+    }
 }
 
 //////////////////////////////////////////////////////////////////////////
 
-string_stream parser::operator()(const std::vector<std::string>& init_list) const
+void batch_parser::index_results()
 {
-    for (auto& name : init_list)
+    params_index_.reset(params_.size());
+    flags_index_.reset(flags_.size());
+
+    for (size_t cmd = 0; cmd < size(); ++cmd)
     {
-        auto optIt = params_.find(trim_leading_dashes(name));
-        if (params_.end() != optIt)
-            return string_stream(optIt->second);
+        for (auto i = param_offsets_[cmd]; i < param_offsets_[cmd + 1]; ++i)
+        {
+            auto const& name = params_[i].first;
+            params_index_.insert_hashed(command_hash(cmd, name), i, [&](uint32_t pos) { return pos >= param_offsets_[cmd] && params_[pos].first == name; });
+        }
+        for (auto i = flag_offsets_[cmd]; i < flag_offsets_[cmd + 1]; ++i)
+        {
+            auto const& name = flags_[i];
+            flags_index_.insert_hashed(command_hash(cmd, name), i, [&](uint32_t pos) { return pos >= flag_offsets_[cmd] && flags_[pos] == name; });
+        }
     }
-    return bad_stream();
 }
 
 //////////////////////////////////////////////////////////////////////////
 
-string_stream parser::operator()(size_t ind) const
+uint32_t batch_parser::find_param(size_t cmd, string_ref name) const
 {
-    if (pos_args_.size() <= ind)
-        return bad_stream();
+    auto trimmed = detail::trim_leading_dashes(name);
+    return params_index_.find_hashed(command_hash(cmd, trimmed), [&](uint32_t pos)
+    {
+        return pos >= param_offsets_[cmd] && pos < param_offsets_[cmd + 1] && params_[pos].first == trimmed;
+    });
+}
+
+//////////////////////////////////////////////////////////////////////////
 
-    return string_stream(pos_args_[ind]);
+bool batch_parser::got_flag(size_t cmd, string_ref name) const
+{
+    auto trimmed = detail::trim_leading_dashes(name);
+    return detail::name_index::npos != flags_index_.find_hashed(command_hash(cmd, trimmed), [&](uint32_t pos)
+    {
+        return pos >= flag_offsets_[cmd] && pos < flag_offsets_[cmd + 1] && flags_[pos] == trimmed;
+    });
 }
 
 //////////////////////////////////////////////////////////////////////////
 
-void parser::add_param(std::string const& name)
+batch_parser::command batch_parser::operator[](size_t ind) const
 {
-    registeredParams_.insert(trim_leading_dashes(name));
+    assert(ind < size());
+    return command(*this, ind);
 }
 
 //////////////////////////////////////////////////////////////////////////
 
-void parser::add_param(const std::vector<std::string>& init_list)
+bool batch_parser::command::operator[](string_ref name) const
 {
-    parser::add_params(init_list);
+    return owner_->got_flag(index_, name);
 }
 
 //////////////////////////////////////////////////////////////////////////
 
-void parser::add_params(const std::vector<std::string>& init_list)
+bool batch_parser::command::operator[](const std::vector<std::string>& init_list) const
 {
-    for (auto& name : init_list)
-        registeredParams_.insert(trim_leading_dashes(name));
+    return std::any_of(init_list.begin(), init_list.end(), [&](const std::string& name) { return owner_->got_flag(index_, name); });
 }
 
 //////////////////////////////////////////////////////////////////////////
 
-void parser::add_params(const std::string &name)
+bool batch_parser::command::operator[](std::initializer_list<string_ref> init_list) const
 {
-    parser::add_param(name);
+    return std::any_of(init_list.begin(), init_list.end(), [&](string_ref name) { return owner_->got_flag(index_, name); });
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+string_ref batch_parser::command::operator[](size_t ind) const
+{
+    if (ind < size())
+        return owner_->pos_args_[owner_->pos_offsets_[index_] + ind];
+    return string_ref();
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+string_stream batch_parser::command::operator()(size_t ind) const
+{
+    if (size() <= ind)
+        return bad_stream();
+
+    return string_stream::view((*this)[ind]);
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+string_stream batch_parser::command::operator()(string_ref name) const
+{
+    auto pos = owner_->find_param(index_, name);
+    if (detail::name_index::npos != pos)
+        return string_stream::view(owner_->params_[pos].second);
+    return bad_stream();
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+string_stream batch_parser::command::operator()(const std::vector<std::string>& init_list) const
+{
+    auto pos = find_any_param(init_list);
+    if (detail::name_index::npos != pos)
+        return string_stream::view(owner_->params_[pos].second);
+    return bad_stream();
+}
+
+//////////////////////////////////////////////////////////////////////////
+
+string_stream batch_parser::command::operator()(std::initializer_list<string_ref> init_list) const
+{
+    auto pos = find_any_param(init_list);
+    if (detail::name_index::npos != pos)
+        return string_stream::view(owner_->params_[pos].second);
+    return bad_stream();
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -1,132 +1,1248 @@
-#pragma once
-
-#include <algorithm>
-#include <sstream>
-#include <limits>
-#include <string>
-#include <vector>
-#include <set>
-#include <map>
-#include <cassert>
-
-namespace argh
-{
-   class stringstream_proxy
-   {
-   public:
-      stringstream_proxy() = default;
-
-      // Construct with a value.
-      stringstream_proxy(std::string const& value);
-
-      // Copy constructor.
-      stringstream_proxy(const stringstream_proxy& other);
-
-      stringstream_proxy& operator=(const stringstream_proxy& other);
-
-      void setstate(std::ios_base::iostate state);
-
-      stringstream_proxy& operator>>(bool& value);
-      stringstream_proxy& operator>>(double& value);
-      stringstream_proxy& operator>>(char*& value);
-      stringstream_proxy& operator>>(std::string& value);
-      stringstream_proxy& operator>>(float& value);
-      stringstream_proxy& operator>>(char& value);
-      stringstream_proxy& operator>>(short& value);
-      stringstream_proxy& operator>>(int& value);
-      stringstream_proxy& operator>>(long& value);
-      stringstream_proxy& operator>>(long long& value);
-      stringstream_proxy& operator>>(unsigned char& value);
-      stringstream_proxy& operator>>(unsigned short& value);
-      stringstream_proxy& operator>>(unsigned int& value);
-      stringstream_proxy& operator>>(unsigned long& value);
-      stringstream_proxy& operator>>(unsigned long long& value);
-
-      // Get the string value.
-      std::string str() const;
-
-      // Check the state of the stream.
-      // False when the most recent stream operation failed
-      explicit operator bool() const;
-
-      ~stringstream_proxy() = default;
-
-   private:
-      std::istringstream stream_;
-   };
-
-   using string_stream = stringstream_proxy;
-
-   enum Mode { PREFER_FLAG_FOR_UNREG_OPTION = 1 << 0,
-               PREFER_PARAM_FOR_UNREG_OPTION = 1 << 1,
-               NO_SPLIT_ON_EQUALSIGN = 1 << 2,
-               SINGLE_DASH_IS_MULTIFLAG = 1 << 3,
-    };
-
-   class parser
-   {
-   public:
-      parser() = default;
-
-      parser(const std::vector<std::string>& pre_reg_names)
-      {  add_params(pre_reg_names); }
-
-      parser(const char* const argv[], int mode = PREFER_FLAG_FOR_UNREG_OPTION)
-      {  parse(argv, mode); }
-
-      parser(int argc, const char* const argv[], int mode = PREFER_FLAG_FOR_UNREG_OPTION)
-      {  parse(argc, argv, mode); }
-
-      void add_param(std::string const& name);
-      void add_params(std::string const& name);
-
-      void add_param(const std::vector<std::string>& init_list);
-      void add_params(const std::vector<std::string>& init_list);
-
-      void parse(const char* const argv[], int mode = PREFER_FLAG_FOR_UNREG_OPTION);
-      void parse(int argc, const char* const argv[], int mode = PREFER_FLAG_FOR_UNREG_OPTION);
-
-      size_t size()                                    const { return pos_args_.size();   }
-
-      //////////////////////////////////////////////////////////////////////////
-      // Accessors
-
-      // flag (boolean) accessors: return true if the flag appeared, otherwise false.
-      bool operator[](std::string const& name) const;
-
-      // multiple flag (boolean) accessors: return true if at least one of the flag appeared, otherwise false.
-      bool operator[](const std::vector<std::string>& init_list) const;
-
-      // returns positional arg string by order. Like argv[] but without the options
-      std::string const& operator[](size_t ind) const;
-
-      // returns a std::istream that can be used to convert a positional arg to a typed value.
-      string_stream operator()(size_t ind) const;
-
-      // parameter accessors, give a name get an std::istream that can be used to convert to a typed value.
-      // call .str() on result to get as string
-      string_stream operator()(std::string const& name) const;
-
-      // accessor for a parameter with multiple names, give a list of names, get an std::istream that can be used to convert to a typed value.
-      // call .str() on result to get as string
-      // returns the first value in the list to be found.
-      string_stream operator()(const std::vector<std::string>& init_list) const;
-
-   private:
-      string_stream bad_stream() const;
-      std::string trim_leading_dashes(std::string const& name) const;
-      bool is_number(std::string const& arg) const;
-      bool is_option(std::string const& arg) const;
-      bool got_flag(std::string const& name) const;
-      bool is_param(std::string const& name) const;
-
-   private:
-      std::vector<std::string> args_;
-      std::multimap<std::string, std::string> params_;
-      std::vector<std::string> pos_args_;
-      std::multiset<std::string> flags_;
-      std::set<std::string> registeredParams_;
-      std::string empty_;
-   };
-
-}
+#pragma once
+
+#include <algorithm>
+#include <initializer_list>
+#include <ios>
+#include <iosfwd>
+#include <limits>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cassert>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <atomic>
+#include <mutex>
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define ARGH_HAS_PMR 1
+#endif
+#endif
+
+namespace argh
+{
+   // Non-owning reference to a run of characters: a pointer and a length.
+   // Whoever hands one out is responsible for keeping the characters alive.
+   class string_ref
+   {
+   public:
+      static const size_t npos = static_cast<size_t>(-1);
+
+      string_ref() = default;
+      string_ref(const char* str) : data_(str), size_(str ? std::char_traits<char>::length(str) : 0) {}
+      constexpr string_ref(const char* data, size_t size) : data_(data), size_(size) {}
+      string_ref(std::string const& str) : data_(str.data()), size_(str.size()) {}
+
+      constexpr const char* data()                     const { return data_;           }
+      constexpr size_t size()                          const { return size_;           }
+      bool empty()                                     const { return 0 == size_;      }
+      const char* begin()                              const { return data_;           }
+      const char* end()                                const { return data_ + size_;   }
+      char operator[](size_t ind)                      const { return data_[ind];      }
+      char front()                                     const { return data_[0];        }
+      char back()                                      const { return data_[size_ - 1]; }
+
+      string_ref substr(size_t pos, size_t count = npos) const;
+      size_t find(char c, size_t pos = 0) const;
+      size_t find_first_not_of(char c, size_t pos = 0) const;
+      int compare(string_ref other) const;
+
+      // Copy the referenced characters into an owning string.
+      std::string str()                                const { return std::string(data_, size_); }
+      operator std::string()                           const { return str(); }
+
+   private:
+      const char* data_ = nullptr;
+      size_t size_ = 0;
+   };
+
+   inline bool operator==(string_ref lhs, string_ref rhs) { return lhs.size() == rhs.size() && 0 == lhs.compare(rhs); }
+   inline bool operator!=(string_ref lhs, string_ref rhs) { return !(lhs == rhs); }
+   inline bool operator< (string_ref lhs, string_ref rhs) { return lhs.compare(rhs) <  0; }
+   inline bool operator> (string_ref lhs, string_ref rhs) { return lhs.compare(rhs) >  0; }
+   inline bool operator<=(string_ref lhs, string_ref rhs) { return lhs.compare(rhs) <= 0; }
+   inline bool operator>=(string_ref lhs, string_ref rhs) { return lhs.compare(rhs) >= 0; }
+
+   std::ostream& operator<<(std::ostream& os, string_ref str);
+
+   //////////////////////////////////////////////////////////////////////////
+   // Memory
+
+   // Where a parser gets the memory for everything it stores, modelled on std::pmr::memory_resource.
+   class memory_resource
+   {
+   public:
+      virtual ~memory_resource() = default;
+
+      void* allocate(size_t bytes, size_t alignment)              { return do_allocate(bytes, alignment); }
+      void deallocate(void* p, size_t bytes, size_t alignment)    { do_deallocate(p, bytes, alignment); }
+
+   protected:
+      virtual void* do_allocate(size_t bytes, size_t alignment) = 0;
+      virtual void do_deallocate(void* p, size_t bytes, size_t alignment) = 0;
+   };
+
+   // ::operator new and delete. Used when no resource is given.
+   memory_resource* new_delete_resource();
+
+   // An arena: hands out memory from buffer, then from ever larger blocks taken from upstream.
+   // deallocate() does nothing, all the memory is given back at once by release() or the destructor.
+   // Not thread-safe.
+   class monotonic_resource : public memory_resource
+   {
+   public:
+      explicit monotonic_resource(memory_resource* upstream = new_delete_resource())
+         : monotonic_resource(nullptr, 0, upstream) {}
+      monotonic_resource(void* buffer, size_t size, memory_resource* upstream = new_delete_resource());
+      ~monotonic_resource();
+
+      monotonic_resource(const monotonic_resource&) = delete;
+      monotonic_resource& operator=(const monotonic_resource&) = delete;
+
+      // give the upstream blocks back and start over at the beginning of buffer.
+      void release();
+
+   protected:
+      void* do_allocate(size_t bytes, size_t alignment) override;
+      void do_deallocate(void*, size_t, size_t) override {}
+
+   private:
+      struct block
+      {
+         block* next;
+         size_t size;
+      };
+
+      memory_resource* upstream_;
+      char* buffer_;
+      size_t buffer_size_;
+      char* next_;
+      size_t left_;
+      block* blocks_ = nullptr;
+      size_t next_block_size_;
+   };
+
+#ifdef ARGH_HAS_PMR
+   // Lets a std::pmr::memory_resource (e.g. a std::pmr::monotonic_buffer_resource) back a parser.
+   class pmr_resource : public memory_resource
+   {
+   public:
+      explicit pmr_resource(std::pmr::memory_resource* upstream) : upstream_(upstream) {}
+
+   protected:
+      void* do_allocate(size_t bytes, size_t alignment) override                { return upstream_->allocate(bytes, alignment); }
+      void do_deallocate(void* p, size_t bytes, size_t alignment) override      { upstream_->deallocate(p, bytes, alignment); }
+
+   private:
+      std::pmr::memory_resource* upstream_;
+   };
+#endif
+
+   // Allocates from a memory_resource, like std::pmr::polymorphic_allocator.
+   // Copies (including the copies containers make of themselves) keep using the same resource.
+   template <typename T>
+   class allocator
+   {
+   public:
+      using value_type = T;
+      template <typename U> struct rebind { using other = allocator<U>; };
+
+      allocator() : resource_(new_delete_resource()) {}
+      allocator(memory_resource* resource) : resource_(resource) {}
+      template <typename U>
+      allocator(allocator<U> const& other) : resource_(other.resource()) {}
+
+      T* allocate(size_t n)
+      {
+         if (n > static_cast<size_t>(-1) / sizeof(T))
+            throw std::bad_alloc();
+         return static_cast<T*>(resource_->allocate(n * sizeof(T), alignof(T)));
+      }
+      void deallocate(T* p, size_t n)                                                { resource_->deallocate(p, n * sizeof(T), alignof(T)); }
+
+      memory_resource* resource()                      const { return resource_; }
+
+   private:
+      memory_resource* resource_;
+   };
+
+   template <typename T, typename U>
+   bool operator==(allocator<T> const& lhs, allocator<U> const& rhs) { return lhs.resource() == rhs.resource(); }
+   template <typename T, typename U>
+   bool operator!=(allocator<T> const& lhs, allocator<U> const& rhs) { return !(lhs == rhs); }
+
+   class schema;
+
+   namespace detail
+   {
+      template <typename T>
+      using vector = std::vector<T, allocator<T>>;
+
+      // true when arg would be read as a number by std::istream >> double (e.g. "-1", "2.5e3", "-7abc").
+      // Recognizes exactly what the stream accepts, without a stream, a locale or any allocation.
+      bool is_number(string_ref arg);
+
+      // Convert all of str to value, without a stream or an allocation.
+      // Return false, leaving value untouched, if str is not entirely a valid representation of the type
+      // or is out of its range. Integers are decimal with an optional sign ('-' only for signed types),
+      // bool is "0" or "1", char types take exactly one character.
+      bool convert(string_ref str, bool& value);
+      bool convert(string_ref str, char& value);
+      bool convert(string_ref str, unsigned char& value);
+      bool convert(string_ref str, short& value);
+      bool convert(string_ref str, int& value);
+      bool convert(string_ref str, long& value);
+      bool convert(string_ref str, long long& value);
+      bool convert(string_ref str, unsigned short& value);
+      bool convert(string_ref str, unsigned int& value);
+      bool convert(string_ref str, unsigned long& value);
+      bool convert(string_ref str, unsigned long long& value);
+      bool convert(string_ref str, float& value);
+      bool convert(string_ref str, double& value);
+      bool convert(string_ref str, std::string& value);
+      bool convert(string_ref str, string_ref& value);
+
+      // 32-bit FNV-1a, used for all name lookups.
+      inline uint32_t hash(string_ref str)
+      {
+         uint32_t h = 2166136261u;
+         for (auto c : str)
+            h = (h ^ static_cast<unsigned char>(c)) * 16777619u;
+         return h;
+      }
+
+      // the same hash, computed at compile time for a constant str (see option_name)
+      constexpr uint32_t constexpr_hash(const char* str, size_t size, uint32_t h = 2166136261u)
+      {
+         return 0 == size ? h : constexpr_hash(str + 1, size - 1, (h ^ static_cast<unsigned char>(*str)) * 16777619u);
+      }
+
+      // what trim_leading_dashes drops from str, at compile time: its leading dashes, unless it has nothing else
+      constexpr size_t constexpr_dashes(const char* str, size_t size, size_t pos = 0)
+      {
+         return pos < size && '-' == str[pos] ? constexpr_dashes(str, size, pos + 1) : (pos == size ? 0 : pos);
+      }
+
+      // Open-addressing hash index over names stored elsewhere, in a container addressed by position.
+      // Each distinct name maps to the position it was first inserted with.
+      // name_at(pos) must return the name stored at pos.
+      class name_index
+      {
+      public:
+         static const uint32_t npos = static_cast<uint32_t>(-1);
+
+         explicit name_index(memory_resource* resource = new_delete_resource()) : slots_(resource) {}
+
+         // drop all entries and size the table for count names, keeping the allocated capacity.
+         void reset(size_t count);
+
+         // make room for count names in all, so that inserting up to that many rehashes no more.
+         void reserve(size_t count);
+
+         // insert name at pos. returns false (and keeps the old entry) if the name is already present.
+         template <typename NameAt>
+         bool insert(string_ref name, uint32_t pos, NameAt const& name_at)
+         {  return insert_hashed(hash(name), pos, [&](uint32_t p) { return name_at(p) == name; }); }
+
+         // returns the position of name, or npos.
+         template <typename NameAt>
+         uint32_t find(string_ref name, NameAt const& name_at) const
+         {  return find_hashed(hash(name), [&](uint32_t p) { return name_at(p) == name; }); }
+
+         // the same for keys other than a plain name: h is the key's hash, equals_at(pos) compares the
+         // key with the one stored at pos.
+         template <typename EqualsAt>
+         bool insert_hashed(uint32_t h, uint32_t pos, EqualsAt const& equals_at);
+         template <typename EqualsAt>
+         uint32_t find_hashed(uint32_t h, EqualsAt const& equals_at) const;
+
+         size_t size() const { return size_; }
+
+      private:
+         struct slot
+         {
+            uint32_t hash;
+            uint32_t pos;    // position + 1, 0 for an empty slot
+         };
+
+         static size_t capacity_for(size_t count);
+         void rehash(size_t capacity);
+
+         vector<slot> slots_;
+         size_t size_ = 0;
+      };
+
+      template <typename EqualsAt>
+      bool name_index::insert_hashed(uint32_t h, uint32_t pos, EqualsAt const& equals_at)
+      {
+         if (2 * (size_ + 1) > slots_.size())
+            rehash(std::max<size_t>(8, 2 * slots_.size()));
+
+         auto mask = slots_.size() - 1;
+         for (auto i = h & mask; ; i = (i + 1) & mask)
+         {
+            auto& s = slots_[i];
+            if (0 == s.pos)
+            {
+               s.hash = h;
+               s.pos = pos + 1;
+               ++size_;
+               return true;
+            }
+            if (s.hash == h && equals_at(s.pos - 1))
+               return false;
+         }
+      }
+
+      template <typename EqualsAt>
+      uint32_t name_index::find_hashed(uint32_t h, EqualsAt const& equals_at) const
+      {
+         if (slots_.empty())
+            return npos;
+
+         auto mask = slots_.size() - 1;
+         for (auto i = h & mask; ; i = (i + 1) & mask)
+         {
+            auto const& s = slots_[i];
+            if (0 == s.pos)
+               return npos;
+            if (s.hash == h && equals_at(s.pos - 1))
+               return s.pos - 1;
+         }
+      }
+
+      // A set of owned names, e.g. the registered params.
+      class name_set
+      {
+      public:
+         explicit name_set(memory_resource* resource = new_delete_resource())
+            : chars_(resource), ends_(resource), index_(resource) {}
+
+         // returns false if name was already in the set.
+         bool insert(string_ref name);
+         bool contains(string_ref name) const;
+
+         // the position of name, whose hash is h, or name_index::npos.
+         uint32_t find(string_ref name, uint32_t h) const;
+
+         // make room for count more names of chars characters in all, e.g. before a bulk insert.
+         void reserve(size_t count, size_t chars);
+
+         // the names in order of insertion
+         size_t size()                                 const { return ends_.size(); }
+         string_ref name_at(uint32_t pos) const;
+
+      private:
+
+         // the names back to back, name i ending at ends_[i]
+         vector<char> chars_;
+         vector<uint32_t> ends_;
+         name_index index_;
+      };
+
+      // Single character flags, e.g. the x, v and f of "-xvf" in SINGLE_DASH_IS_MULTIFLAG mode: a bit and an
+      // occurrence count per character, so that adding and finding one is O(1), without hashing.
+      class char_flags
+      {
+      public:
+         void add(char c)                                    { auto u = static_cast<unsigned char>(c); bits_[u >> 6] |= uint64_t(1) << (u & 63); ++counts_[u]; }
+         bool contains(char c)                         const { auto u = static_cast<unsigned char>(c); return 0 != (bits_[u >> 6] & (uint64_t(1) << (u & 63))); }
+         uint32_t count(char c)                        const { return counts_[static_cast<unsigned char>(c)]; }
+
+         // touches only the counts of the characters present
+         void clear();
+
+      private:
+         uint64_t bits_[4] = {};
+         uint32_t counts_[256] = {};
+      };
+
+      // std::string copies of views, built on first request and kept until reset(), so that references to them
+      // stay valid meanwhile. Concurrent get()s are safe: the first thread to publish a copy wins. A copy of
+      // the cache starts out empty, with as many slots. The strings are allocated from the resource.
+      class string_cache
+      {
+      public:
+         explicit string_cache(memory_resource* resource = new_delete_resource()) : slots_(resource) {}
+         string_cache(string_cache const& other) : slots_(other.slots_.size(), other.slots_.get_allocator()) {}
+         string_cache(string_cache&& other) : slots_(std::move(other.slots_)) {}
+         string_cache& operator=(string_cache const& other)            { reset(other.slots_.size()); return *this; }
+         ~string_cache()                                               { reset(0); }
+
+         // drop the strings and make room for count of them. needs exclusive access.
+         void reset(size_t count);
+
+         // the copy of view held in slot ind, which must be below the count given to reset()
+         std::string const& get(size_t ind, string_ref view) const;
+
+      private:
+         mutable vector<std::atomic<std::string*>> slots_;
+      };
+
+      // The known option names (registered params and schema spellings) in sorted order, to expand an
+      // unambiguous prefix to the name it abbreviates, as GNU getopt_long does, with a binary search.
+      // The names starting with a prefix are adjacent, so two searches bound them, and a precomputed
+      // run length tells whether they are all spellings of one option (then the prefix is unambiguous).
+      class prefix_index
+      {
+      public:
+         enum match { none, unique, ambiguous };
+
+         // the shortest prefix expanded: an empty one would match every name, and a single character says
+         // too little to pick one (e.g. the "x" of "--x" for "--xml").
+         static const size_t min_prefix = 2;
+
+         prefix_index(name_set const& registered, schema const* options, memory_resource* resource = new_delete_resource());
+
+         // replace name with the known name it is a prefix of (name itself if known), if there is only one.
+         // none for a name shorter than min_prefix.
+         match expand(string_ref& name) const;
+
+         // number of registered params it was built with
+         size_t registered()                           const { return registered_; }
+
+      private:
+         struct entry
+         {
+            uint32_t offset;                    // into chars_
+            uint32_t size;
+            uint32_t id;                        // schema option id, or a distinct one per registered param
+            uint32_t run_end;                   // index of the next entry with another id
+         };
+
+         string_ref name_of(entry const& e)    const { return string_ref(chars_.data() + e.offset, e.size); }
+
+         vector<char> chars_;
+         vector<entry> names_;
+         size_t registered_;
+      };
+
+      // "--name" -> "name". A name made only of dashes is kept as is.
+      string_ref trim_leading_dashes(string_ref name);
+
+      // copy the characters args refer to into one buffer, each arg NUL terminated, and point args there.
+      // storage is reused, keeping its capacity, unless other owners share it. A new buffer (and its
+      // shared_ptr control block) is then allocated from resource.
+      void copy_args(string_ref* first, string_ref* last, std::shared_ptr<vector<char>>& storage,
+                     memory_resource* resource = new_delete_resource());
+
+      // split command_line into words like a POSIX shell, without expansions: blanks separate words,
+      // '...' quotes everything, "..." quotes everything but \" \\ \$ \` and \<newline>, a backslash
+      // outside quotes escapes the next character and \<newline> joins lines. An unterminated quote runs
+      // to the end. The unquoted words are written into buffer, NUL terminated, and args set to refer to them.
+      //
+      // scan picks how runs of ordinary characters are found: a byte at a time (the reference), or 16 / 32
+      // bytes at a time with SSE2 / AVX2. All give the same words; a scanner the CPU lacks falls back to
+      // best_scanner(), the fastest one it has. Define ARGH_NO_SIMD to build the scalar one only.
+      enum class scanner { scalar, sse2, avx2 };
+      scanner best_scanner();
+      void tokenize(string_ref command_line, vector<string_ref>& args, vector<char>& buffer, scanner scan = best_scanner());
+
+      // the same, overwriting [first, last) with the words and appending them to args.
+      // only the last word lacks a NUL when it ends at last.
+      void tokenize_in_place(char* first, char* last, vector<string_ref>& args, scanner scan = best_scanner());
+
+      // The contents of a file, privately writable: changes are never written back.
+      // Memory mapped (MAP_PRIVATE) for regular files on POSIX systems, read into memory otherwise.
+      class mapped_file
+      {
+      public:
+         mapped_file() = default;
+         // false if path cannot be read.
+         explicit mapped_file(const char* path);
+         mapped_file(mapped_file&& other) noexcept;
+         mapped_file& operator=(mapped_file&& other) noexcept;
+         ~mapped_file();
+
+         mapped_file(const mapped_file&) = delete;
+         mapped_file& operator=(const mapped_file&) = delete;
+
+         explicit operator bool()                      const { return valid_; }
+         char* data()                                        { return data_; }
+         size_t size()                                 const { return size_; }
+
+         // the same file, by device and inode on POSIX systems, by path elsewhere.
+         bool same_file(mapped_file const& other)      const { return id_ == other.id_; }
+
+      private:
+         void swap(mapped_file& other) noexcept;
+
+         char* data_ = nullptr;
+         size_t size_ = 0;
+         bool valid_ = false;
+         bool mapped_ = false;
+         std::vector<char> read_;      // the contents, when read rather than mapped
+         std::string id_;
+      };
+
+      // append the NUL separated args of buffer (see parser::parse_nul_delimited) to args.
+      void split_nul_delimited(const char* buffer, size_t size, vector<string_ref>& args);
+
+      // Defers classifying a parser's args (see LAZY) to the first access, and runs it once even when
+      // first accesses race. A base of the parser rather than a member, so that copying a parser finishes
+      // the source's classification before any of its results are copied.
+      template <typename Owner>
+      class lazy_classification
+      {
+      protected:
+         lazy_classification() = default;
+         lazy_classification(lazy_classification const& other)                 { other.resolve(); }
+         lazy_classification& operator=(lazy_classification const& other)      { other.resolve(); pending_mode_ = none; return *this; }
+
+         // classify with mode on first access. needs exclusive access, like parse().
+         void defer(int mode)                                                    { pending_mode_ = mode; }
+         void cancel()                                                           { pending_mode_ = none; }
+
+         // Owner::classify(mode) const, unless already done
+         void resolve() const
+         {
+            if (none == pending_mode_.load(std::memory_order_acquire))
+               return;
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto mode = pending_mode_.load(std::memory_order_relaxed);
+            if (none == mode)
+               return;
+            static_cast<Owner const&>(*this).classify(mode);
+            pending_mode_.store(none, std::memory_order_release);
+         }
+
+      private:
+         static const int none = -1;
+         mutable std::atomic<int> pending_mode_{ none };
+         mutable std::mutex mutex_;
+      };
+
+      // replace each "@file" arg after the first (the program) with the words in file, tokenized in place
+      // (see tokenize). Words that are "@file" again are expanded in turn. The files are kept in files,
+      // which must outlive args. An @file that cannot be read, or that is already being expanded (a cycle),
+      // stays as it is.
+      void expand_response_files(vector<string_ref>& args, vector<mapped_file>& files);
+
+      // classify args into positional args, params and flags (see Mode), appending them in command line order.
+      // the params of options, if given, count as registered too. Returns where the tail left unclassified by
+      // STOP_AT_DOUBLE_DASH / STOP_AT_FIRST_POSITIONAL starts, or count.
+      // With abbreviations, "--" options that abbreviate a known name unambiguously take that name (it then
+      // refers into abbreviations), and the names of ambiguous ones are appended to ambiguous.
+      size_t parse_args(string_ref const* args, size_t count, int mode, name_set const& registered,
+                        vector<string_ref>& pos_args,
+                        vector<std::pair<string_ref, string_ref>>& params,
+                        vector<string_ref>& flags,
+                        schema const* options = nullptr,
+                        prefix_index const* abbreviations = nullptr,
+                        vector<string_ref>* ambiguous = nullptr);
+   }
+
+   // A minimal std::istringstream stand-in for reading typed values from an arg.
+   // Extraction follows std::istream >> (classic "C" locale, C++11 failure values) but is implemented
+   // directly on the characters: no std::locale is copied or consulted, so proxies can be created and
+   // read concurrently from many threads without shared state.
+   class stringstream_proxy
+   {
+   public:
+      stringstream_proxy() = default;
+
+      // Construct with a value.
+      stringstream_proxy(std::string const& value);
+
+      // Refer to value without copying it. value must outlive the proxy.
+      static stringstream_proxy view(string_ref value);
+
+      // Copy constructor.
+      stringstream_proxy(const stringstream_proxy& other);
+
+      stringstream_proxy& operator=(const stringstream_proxy& other);
+
+      void setstate(std::ios_base::iostate state);
+
+      stringstream_proxy& operator>>(bool& value);
+      stringstream_proxy& operator>>(double& value);
+      stringstream_proxy& operator>>(char*& value);
+      stringstream_proxy& operator>>(std::string& value);
+      stringstream_proxy& operator>>(float& value);
+      stringstream_proxy& operator>>(char& value);
+      stringstream_proxy& operator>>(short& value);
+      stringstream_proxy& operator>>(int& value);
+      stringstream_proxy& operator>>(long& value);
+      stringstream_proxy& operator>>(long long& value);
+      stringstream_proxy& operator>>(unsigned char& value);
+      stringstream_proxy& operator>>(unsigned short& value);
+      stringstream_proxy& operator>>(unsigned int& value);
+      stringstream_proxy& operator>>(unsigned long& value);
+      stringstream_proxy& operator>>(unsigned long long& value);
+
+      // Get the string value.
+      std::string str() const;
+
+      // Check the state of the stream.
+      // False when the most recent stream operation failed
+      explicit operator bool() const;
+
+      ~stringstream_proxy() = default;
+
+   private:
+      // skip leading whitespace like the std::istream sentry. false (and failbit set) if nothing can be read.
+      bool sentry();
+      template <typename T> stringstream_proxy& extract_integer(T& value);
+      template <typename T> stringstream_proxy& extract_clamped(T& value);
+      template <typename T, typename Strto> stringstream_proxy& extract_float(T& value, Strto strto);
+
+      std::string owned_;     // the value, unless the proxy is a view
+      string_ref str_;        // the characters read: owned_ or the viewed value
+      size_t pos_ = 0;
+      std::ios_base::iostate state_ = std::ios_base::goodbit;
+   };
+
+   using string_stream = stringstream_proxy;
+
+   enum Mode { PREFER_FLAG_FOR_UNREG_OPTION = 1 << 0,
+               PREFER_PARAM_FOR_UNREG_OPTION = 1 << 1,
+               NO_SPLIT_ON_EQUALSIGN = 1 << 2,
+               SINGLE_DASH_IS_MULTIFLAG = 1 << 3,
+               // Keep references into the caller's argv instead of copying it.
+               // argv must then outlive the parser and every string_ref obtained from it.
+               NO_COPY_ARGV = 1 << 4,
+               // Replace "@file" args with the args in file, split like a command line string (see
+               // parse(string_ref)), e.g. a compiler's response file. The files are memory mapped and
+               // their args refer into the mapping, for as long as the parser or a copy of it is alive.
+               EXPAND_RESPONSE_FILES = 1 << 5,
+               // Only record the args in parse(), and classify them on the first access instead (with the
+               // same results). Saves the work for tools that exit without looking at their args.
+               LAZY = 1 << 6,
+               // Stop at a "--" arg: it and everything after it are left out of the results, untouched (see parser::tail()).
+               STOP_AT_DOUBLE_DASH = 1 << 7,
+               // Stop at the first positional arg after argv[0], e.g. a subcommand name. It is still a positional
+               // arg, and everything after it is left out of the results, untouched (see parser::tail()).
+               STOP_AT_FIRST_POSITIONAL = 1 << 8,
+               // Accept unambiguous prefixes of registered params (and of schema spellings) for "--" options,
+               // e.g. "--verb" for "--verbose", of at least two characters. The results keep the full names,
+               // which the accessors then take. Ambiguous prefixes are kept as typed, and listed by parser::ambiguous().
+               ALLOW_ABBREVIATIONS = 1 << 9,
+    };
+
+   // Dense id of an option in a schema: its position in the schema.
+   // Converts from an enum class listing the options in schema order.
+   class option_id
+   {
+   public:
+      explicit option_id(uint32_t value) : value_(value) {}
+
+      template <typename E, typename = typename std::enable_if<std::is_enum<E>::value>::type>
+      option_id(E e) : value_(static_cast<uint32_t>(e)) {}
+
+      uint32_t value()                                 const { return value_; }
+
+   private:
+      uint32_t value_;
+   };
+
+   // A tool's options, declared once up front: option i (option_id i) is spelled by any of its names.
+   // Construction builds a perfect hash over all the spellings, so a name lookup costs one hash and one
+   // comparison with the single spelling it can be, and a parser using the schema answers lookups by
+   // option_id with plain array indexing. Build it once (e.g. as a static) and share it between parsers.
+   class schema
+   {
+   public:
+      static const uint32_t npos = static_cast<uint32_t>(-1);
+
+      struct option
+      {
+         std::vector<std::string> names;     // leading dashes are optional
+         bool is_param;                      // takes a value (like add_param()), otherwise a flag
+      };
+
+      // a spelling used twice keeps its first option.
+      explicit schema(std::vector<option> const& options);
+
+      // number of options
+      size_t size()                                    const { return is_param_.size(); }
+
+      // the id of the option spelled name (leading dashes are optional), or npos.
+      uint32_t find(string_ref name) const;
+
+      // the same for a name without leading dashes whose detail::hash is h, e.g. one already hashed for
+      // another index.
+      uint32_t find_hashed(string_ref name, uint32_t h) const;
+
+      bool is_param(uint32_t id)                       const { return 0 != is_param_[id]; }
+
+      // every spelling (without leading dashes) in order of declaration, and its option's id
+      size_t spelling_count()                          const { return spellings_.size(); }
+      string_ref spelling(size_t ind)                  const { return spellings_[ind]; }
+      uint32_t spelling_id(size_t ind)                 const { return ids_[ind]; }
+
+   private:
+      uint32_t slot_of(uint32_t h, uint32_t displacement) const;
+
+      std::vector<std::string> spellings_;
+      std::vector<uint32_t> ids_;              // option id of each spelling
+      std::vector<char> is_param_;             // per option
+
+      // hash and displace: a name hashing to h belongs in bucket h & (buckets - 1), and can only be the
+      // spelling in slot slot_of(h, displacements_[bucket]).
+      std::vector<uint32_t> displacements_;
+      std::vector<uint32_t> slots_;            // spelling index + 1, 0 for an empty slot
+      std::vector<uint32_t> overflow_;         // spellings no displacement could place (equal hashes)
+   };
+
+   // A view of consecutive args, e.g. parser::tail(). Valid while its parser is alive and not re-parsed.
+   class arg_range
+   {
+   public:
+      arg_range() = default;
+      arg_range(string_ref const* first, string_ref const* last) : first_(first), last_(last) {}
+
+      string_ref const* begin()                        const { return first_;                        }
+      string_ref const* end()                          const { return last_;                         }
+      size_t size()                                    const { return static_cast<size_t>(last_ - first_); }
+      bool empty()                                     const { return first_ == last_;               }
+      string_ref operator[](size_t ind)                const { return first_[ind];                   }
+
+   private:
+      string_ref const* first_ = nullptr;
+      string_ref const* last_ = nullptr;
+   };
+
+   // An option name fixed at compile time, e.g. "--threads"_opt: the compiler strips its dashes and hashes
+   // it, so looking it up in a parser costs one probe of the index and a final comparison.
+   class option_name
+   {
+   public:
+      template <size_t N>
+      constexpr explicit option_name(const char (&literal)[N]) : option_name(literal, N - 1) {}
+
+      constexpr option_name(const char* str, size_t size)
+         : name_(str + detail::constexpr_dashes(str, size), size - detail::constexpr_dashes(str, size))
+         , hash_(detail::constexpr_hash(str + detail::constexpr_dashes(str, size), size - detail::constexpr_dashes(str, size)))
+      {}
+
+      // without leading dashes
+      constexpr string_ref name()                      const { return name_; }
+      constexpr uint32_t hash()                        const { return hash_; }
+
+   private:
+      string_ref name_;
+      uint32_t hash_;
+   };
+
+   inline namespace literals
+   {
+      constexpr option_name operator"" _opt(const char* str, size_t size) { return option_name(str, size); }
+   }
+
+   // A name resolved once against a parse (see parser::handle()), so that querying it again costs a
+   // comparison and an array access. Each parse has its own generation: a handle resolved against an
+   // earlier parse (or another parser) still answers correctly, with a name lookup per query, until it is
+   // resolved anew.
+   class option_handle
+   {
+   public:
+      option_handle() = default;
+
+      std::string const& name()                        const { return name_; }
+
+   private:
+      friend class parser;
+
+      std::string name_;
+      uint64_t generation_ = 0;                // 0 for no parse
+      uint32_t param_ = static_cast<uint32_t>(-1);
+      bool flag_ = false;
+   };
+
+   // Concurrent calls to const members of the same parser (all accessors) are thread-safe:
+   // they only read the parse results (in LAZY mode, the first of them classifies the args, once).
+   // parse() and add_param() need exclusive access.
+   //
+   // Everything the parser stores comes from its memory_resource (::operator new by default), which must
+   // outlive the parser and its copies. Accessors allocate nothing, except for the string_stream results of
+   // operator(), which own a copy of their value (see view() for streams that refer to the parsed characters).
+   class parser : private detail::lazy_classification<parser>
+   {
+   public:
+      parser() = default;
+
+      explicit parser(memory_resource* resource);
+
+      // parse the options of a schema, which must outlive the parser. The schema's params count as registered.
+      explicit parser(schema const& options, memory_resource* resource = new_delete_resource());
+
+      parser(const std::vector<std::string>& pre_reg_names)
+      {  add_params(pre_reg_names); }
+
+      parser(const char* const argv[], int mode = PREFER_FLAG_FOR_UNREG_OPTION)
+      {  parse(argv, mode); }
+
+      parser(int argc, const char* const argv[], int mode = PREFER_FLAG_FOR_UNREG_OPTION)
+      {  parse(argc, argv, mode); }
+
+      void add_param(std::string const& name);
+      void add_params(std::string const& name);
+
+      void add_param(const std::vector<std::string>& init_list);
+      void add_params(const std::vector<std::string>& init_list);
+
+      // register names as spellings of one option, e.g. add_aliases({"-n", "--nice"}): a flag or param given
+      // under any of them is then found under all of them with a single lookup, the first occurrence winning.
+      // A name already in a group keeps it. Aliases apply to the current parse as well, and handles resolved
+      // before them fall back to name lookups. A param registered under any spelling takes a separate value
+      // under all of them (from the next parse on, like add_param).
+      void add_aliases(const std::vector<std::string>& names);
+
+      // parsing again reuses the buffers of the previous parse: once they have grown to fit the
+      // command lines at hand, parse() allocates nothing (unless a copy of the parser shares them).
+      void parse(const char* const argv[], int mode = PREFER_FLAG_FOR_UNREG_OPTION);
+      void parse(int argc, const char* const argv[], int mode = PREFER_FLAG_FOR_UNREG_OPTION);
+
+      // parse a whole command line, e.g. "tool -v --name='a b' file", split into words with shell-like
+      // quoting (see detail::tokenize). The first word plays the part of argv[0]. The words are unquoted
+      // straight into the parser's own storage, so NO_COPY_ARGV has no effect here.
+      void parse(string_ref command_line, int mode = PREFER_FLAG_FOR_UNREG_OPTION);
+
+      // parse args separated by NULs, as in /proc/<pid>/cmdline: every NUL ends an arg (so two in a row make
+      // an empty one), and the last arg may lack its NUL. With NO_COPY_ARGV the args refer into buffer.
+      void parse_nul_delimited(const char* buffer, size_t size, int mode = PREFER_FLAG_FOR_UNREG_OPTION);
+
+      // read path, e.g. "/proc/1234/cmdline", straight into the parser's storage and parse it like
+      // parse_nul_delimited. Returns false, leaving the parser empty, if the file cannot be read.
+      bool parse_cmdline_file(const char* path, int mode = PREFER_FLAG_FOR_UNREG_OPTION);
+
+      // the current process's command line, from /proc/self/cmdline, without needing main()'s argv.
+      // Returns false, leaving the parser empty, where there is no /proc (e.g. outside Linux).
+      bool parse_self_cmdline(int mode = PREFER_FLAG_FOR_UNREG_OPTION)                                 { return parse_cmdline_file("/proc/self/cmdline", mode); }
+
+      size_t size()                                    const { resolve(); return pos_args_.size(); }
+
+      //////////////////////////////////////////////////////////////////////////
+      // Accessors
+
+      // Names are taken as string_refs, so looking up a literal or a std::string allocates nothing.
+
+      // flag (boolean) accessors: return true if the flag appeared, otherwise false.
+      bool operator[](string_ref name) const;
+
+      // multiple flag (boolean) accessors: return true if at least one of the flag appeared, otherwise false.
+      bool operator[](const std::vector<std::string>& init_list) const;
+      bool operator[](std::initializer_list<string_ref> init_list) const;
+
+      // returns positional arg string by order. Like argv[] but without the options.
+      // The string is built on first access, and valid until the parser is destroyed or re-parses.
+      std::string const& operator[](size_t ind) const;
+
+      // the same, as a view of the parsed characters (the caller's, with NO_COPY_ARGV), without building a string.
+      // Valid until the parser is destroyed or re-parses.
+      string_ref pos_view(size_t ind) const;
+
+      // returns a std::istream that can be used to convert a positional arg to a typed value.
+      string_stream operator()(size_t ind) const;
+
+      // parameter accessors, give a name get an std::istream that can be used to convert to a typed value.
+      // call .str() on result to get as string
+      string_stream operator()(string_ref name) const;
+
+      // accessor for a parameter with multiple names, give a list of names, get an std::istream that can be used to convert to a typed value.
+      // call .str() on result to get as string
+      // returns the first value in the list to be found.
+      string_stream operator()(const std::vector<std::string>& init_list) const;
+      string_stream operator()(std::initializer_list<string_ref> init_list) const;
+
+      // the args after the point where STOP_AT_DOUBLE_DASH or STOP_AT_FIRST_POSITIONAL stopped parsing, exactly
+      // as given (empty if parsing did not stop). They are never classified, and with NO_COPY_ARGV never copied
+      // either: they refer to the caller's strings.
+      arg_range tail() const;
+
+      // how many times the single character flag c appeared, e.g. 3 for "-v -v -v", or "-vvv" in SINGLE_DASH_IS_MULTIFLAG mode.
+      size_t count(char c) const;
+
+      // with ALLOW_ABBREVIATIONS, the names of the options that abbreviated more than one known name,
+      // in command line order
+      arg_range ambiguous() const;
+
+      //////////////////////////////////////////////////////////////////////////
+      // Typed accessors
+      // Convert the whole value straight from the parsed characters, without a stream or an allocation
+      // (see detail::convert for the accepted formats). Supports the types stringstream_proxy reads,
+      // and string_ref for a view of the value.
+
+      // return false and leave value untouched if the arg is missing or does not convert.
+      template <typename T> bool get(size_t ind, T& value) const;
+      template <typename T> bool get(string_ref name, T& value) const;
+      template <typename T> bool get(const std::vector<std::string>& init_list, T& value) const;
+      template <typename T> bool get(std::initializer_list<string_ref> init_list, T& value) const;
+
+      // return the converted value, or def if the arg is missing or does not convert.
+      template <typename T> T get_or(size_t ind, T def) const                                         { get(ind, def);       return def; }
+      template <typename T> T get_or(string_ref name, T def) const                                    { get(name, def);      return def; }
+      template <typename T> T get_or(const std::vector<std::string>& init_list, T def) const          { get(init_list, def); return def; }
+      template <typename T> T get_or(std::initializer_list<string_ref> init_list, T def) const        { get(init_list, def); return def; }
+
+      //////////////////////////////////////////////////////////////////////////
+      // Schema accessors
+      // Look an option up by its id in the parser's schema, under any of its spellings.
+      // The first occurrence on the command line wins.
+
+      bool operator[](option_id id) const;
+      string_stream operator()(option_id id) const;
+      template <typename T> bool get(option_id id, T& value) const;
+      template <typename T> T get_or(option_id id, T def) const                                       { get(id, def);        return def; }
+
+      //////////////////////////////////////////////////////////////////////////
+      // Literal accessors
+      // The same as the accessors by name, for names hashed at compile time, e.g. cmdl["-v"_opt].
+
+      bool operator[](option_name name) const;
+      string_stream operator()(option_name name) const;
+      template <typename T> bool get(option_name name, T& value) const;
+      template <typename T> T get_or(option_name name, T def) const                                   { get(name, def);      return def; }
+
+      //////////////////////////////////////////////////////////////////////////
+      // Handle accessors
+      // Resolve a name once with handle(), e.g. before an event loop, then query it without a lookup.
+      // Resolve again after a re-parse to keep queries O(1).
+
+      option_handle handle(string_ref name) const;
+      option_handle handle(option_name name) const;
+      bool operator[](option_handle const& h) const;
+      string_stream operator()(option_handle const& h) const;
+      template <typename T> bool get(option_handle const& h, T& value) const;
+      template <typename T> T get_or(option_handle const& h, T def) const                             { get(h, def);         return def; }
+
+      //////////////////////////////////////////////////////////////////////////
+      // View accessors
+      // The same as operator(), but the stream refers to the parsed characters instead of owning a copy,
+      // so getting one allocates nothing. It must not be read once the parser is destroyed or re-parses.
+
+      string_stream view(size_t ind) const;
+      string_stream view(string_ref name) const;
+      string_stream view(std::initializer_list<string_ref> init_list) const;
+      string_stream view(option_id id) const;
+      string_stream view(option_name name) const;
+      string_stream view(option_handle const& h) const;
+
+      memory_resource* resource()                      const { return args_.get_allocator().resource(); }
+
+   private:
+      friend class detail::lazy_classification<parser>;
+
+      void parse_args(int mode);
+      void classify(int mode) const;
+      void index_results() const;
+      uint32_t alias_group(string_ref name, uint32_t h) const;
+      void register_aliases_of(string_ref param);
+      uint32_t find_param(string_ref name) const;
+      bool got_flag(string_ref name) const;
+      uint32_t find_param(option_handle const& h) const;
+      uint32_t find_param(option_name name) const;
+      bool got_flag(option_name name) const;
+
+      // the first of names found as a param
+      template <typename Names>
+      uint32_t find_any_param(Names const& names) const
+      {
+         for (string_ref name : names)
+         {
+            auto pos = find_param(name);
+            if (detail::name_index::npos != pos)
+               return pos;
+         }
+         return detail::name_index::npos;
+      }
+
+   private:
+      // owned copy of the argument characters, shared between copies of the parser (and only
+      // rewritten while it is not shared). unused when parsing with NO_COPY_ARGV.
+      std::shared_ptr<detail::vector<char>> storage_;
+      // response files of the last parse, shared between copies of the parser like storage_.
+      std::shared_ptr<detail::vector<detail::mapped_file>> files_;
+      detail::vector<string_ref> args_;
+
+      // the results are mutable as classify() fills them in on first access in LAZY mode.
+      mutable detail::vector<string_ref> pos_args_;
+      // the strings operator[](size_t) returns, one slot per positional arg
+      mutable detail::string_cache pos_strings_;
+
+      // every occurrence in command line order, indexed by name once parsing is done.
+      mutable detail::vector<std::pair<string_ref, string_ref>> params_;
+      mutable detail::vector<string_ref> flags_;
+      mutable detail::name_index params_index_;
+      mutable detail::name_index flags_index_;          // flags longer than a character
+      mutable detail::char_flags char_flags_;           // single character flags
+      // index of the first arg of tail()
+      mutable size_t tail_ = 0;
+      mutable detail::vector<string_ref> ambiguous_;
+      // unique to each classification, for checking handles (see option_handle)
+      mutable uint64_t generation_ = 0;
+
+      // the known names, with ALLOW_ABBREVIATIONS. Rebuilt when more have been registered, and shared between
+      // copies of the parser like storage_, as the results may refer to it. Allocated from the parser's resource.
+      std::shared_ptr<detail::prefix_index const> abbreviations_;
+      bool abbreviate_ = false;
+
+      detail::name_set registered_;
+
+      // with a schema: the position of the first param / flag of each option, or npos
+      schema const* schema_ = nullptr;
+      mutable detail::vector<uint32_t> params_by_id_;
+      mutable detail::vector<uint32_t> flags_by_id_;
+
+      // the spellings given to add_aliases() and the group of each, and the position of the first
+      // param / flag of each group, or npos
+      detail::name_set aliases_;
+      detail::vector<uint32_t> alias_groups_;
+      mutable detail::vector<uint32_t> params_by_alias_;
+      mutable detail::vector<uint32_t> flags_by_alias_;
+   };
+
+   //////////////////////////////////////////////////////////////////////////
+
+   template <typename T>
+   bool parser::get(option_id id, T& value) const
+   {
+      resolve();
+      assert(schema_ && id.value() < schema_->size());
+      auto pos = params_by_id_[id.value()];
+      return detail::name_index::npos != pos && detail::convert(params_[pos].second, value);
+   }
+
+   template <typename T>
+   bool parser::get(option_name name, T& value) const
+   {
+      auto pos = find_param(name);
+      return detail::name_index::npos != pos && detail::convert(params_[pos].second, value);
+   }
+
+   template <typename T>
+   bool parser::get(option_handle const& h, T& value) const
+   {
+      auto pos = find_param(h);
+      return detail::name_index::npos != pos && detail::convert(params_[pos].second, value);
+   }
+
+   template <typename T>
+   bool parser::get(size_t ind, T& value) const
+   {
+      resolve();
+      return ind < pos_args_.size() && detail::convert(pos_args_[ind], value);
+   }
+
+   template <typename T>
+   bool parser::get(string_ref name, T& value) const
+   {
+      auto pos = find_param(name);
+      return detail::name_index::npos != pos && detail::convert(params_[pos].second, value);
+   }
+
+   template <typename T>
+   bool parser::get(const std::vector<std::string>& init_list, T& value) const
+   {
+      auto pos = find_any_param(init_list);
+      return detail::name_index::npos != pos && detail::convert(params_[pos].second, value);
+   }
+
+   template <typename T>
+   bool parser::get(std::initializer_list<string_ref> init_list, T& value) const
+   {
+      auto pos = find_any_param(init_list);
+      return detail::name_index::npos != pos && detail::convert(params_[pos].second, value);
+   }
+
+   //////////////////////////////////////////////////////////////////////////
+
+   // Dispatches a command line to one of many subcommands, e.g. "tool remote add origin <url>". The
+   // subcommands' paths are compiled into a trie once, at construction; route() walks it with the words
+   // after argv[0], and parses only the args after the matched path, with only that subcommand's params
+   // registered (on its first use). Build it once and route each command line through it.
+   class router
+   {
+   public:
+      static const uint32_t npos = static_cast<uint32_t>(-1);
+
+      struct command
+      {
+         std::string path;                   // the words naming the subcommand, separated by spaces, e.g. "remote add"
+         std::vector<std::string> params;    // registered with the subcommand's parser (see parser::add_param())
+      };
+
+      // a path given twice keeps its first command. An empty path matches any command line.
+      explicit router(std::vector<command> const& commands);
+
+      // number of subcommands
+      size_t size()                                    const { return parsers_.size(); }
+
+      // match argv[1], argv[2]... against the paths (the longest match wins) and parse the rest with the
+      // matched subcommand's parser, the last word of its path playing the part of argv[0].
+      // Returns the subcommand's index in commands, or npos, leaving every parser untouched, if no path matches.
+      uint32_t route(const char* const argv[], int mode = PREFER_FLAG_FOR_UNREG_OPTION);
+      uint32_t route(int argc, const char* const argv[], int mode = PREFER_FLAG_FOR_UNREG_OPTION);
+
+      // the parser of subcommand id, holding its last routed command line
+      parser const& operator[](uint32_t id)            const { return parsers_[id]; }
+
+   private:
+      // the id of the subcommand with the longest path matching a prefix of [first, last), or npos.
+      // words is set to the length of that path.
+      uint32_t match(const char* const* first, const char* const* last, size_t& words) const;
+
+      struct node
+      {
+         uint32_t first_edge;                // the edges to the children, sorted by word
+         uint32_t edge_count;
+         uint32_t command;                   // the subcommand whose path ends here, or npos
+      };
+
+      struct edge
+      {
+         uint32_t word;                      // offset of the word in words_ (offsets keep copies of the router valid)
+         uint32_t size;
+         uint32_t child;
+      };
+
+      std::string words_;
+      std::vector<node> nodes_;                // nodes_[0] is the root
+      std::vector<edge> edges_;
+
+      std::vector<std::vector<std::string>> params_;
+      std::vector<parser> parsers_;
+      std::vector<char> registered_;           // per subcommand, whether params_ went into its parser yet
+   };
+
+   //////////////////////////////////////////////////////////////////////////
+
+   // Parses many command lines at once into one set of shared arrays (structure of arrays):
+   // the args, positional args, params and flags of all command lines are stored back to back,
+   // with per-command offsets, backed by one copy of the characters and one index per kind.
+   // operator[] gives a parser-like view of a single command line.
+   class batch_parser
+   {
+   public:
+      class command;
+
+      batch_parser() = default;
+
+      batch_parser(const std::vector<std::string>& pre_reg_names)
+      {  add_params(pre_reg_names); }
+
+      // registered params apply to all command lines
+      void add_param(std::string const& name);
+      void add_params(const std::vector<std::string>& init_list);
+
+      // each argv is NULL terminated. With STOP_AT_DOUBLE_DASH / STOP_AT_FIRST_POSITIONAL, the tail of a command
+      // line is left out of its results.
+      void parse(const std::vector<const char* const*>& argvs, int mode = PREFER_FLAG_FOR_UNREG_OPTION);
+
+      // the same as parse(argvs, mode), with the command lines split over worker threads that balance the load
+      // by stealing work from each other. threads == 0 uses one per hardware thread. The result is identical
+      // to the sequential parse.
+      void parse_parallel(const std::vector<const char* const*>& argvs, unsigned threads, int mode = PREFER_FLAG_FOR_UNREG_OPTION);
+
+      // args are NUL terminated, and a command line ends at an empty arg (two NULs in a row) or at the end of the buffer.
+      // e.g. concatenated /proc/<pid>/cmdline contents, each followed by an extra NUL.
+      void parse_nul_delimited(const char* buffer, size_t size, int mode = PREFER_FLAG_FOR_UNREG_OPTION);
+
+      // number of command lines
+      size_t size()                                    const { return arg_offsets_.size() - 1; }
+
+      command operator[](size_t ind) const;
+
+   private:
+      void collect_args(const std::vector<const char* const*>& argvs, int mode);
+      void parse_commands(int mode);
+      void parse_commands_parallel(int mode, unsigned threads);
+      void index_results();
+      uint32_t find_param(size_t cmd, string_ref name) const;
+      bool got_flag(size_t cmd, string_ref name) const;
+
+   private:
+      std::shared_ptr<detail::vector<char>> storage_;
+
+      // command i owns the entries [offsets[i], offsets[i + 1]) of each array
+      detail::vector<string_ref> args_;
+      std::vector<uint32_t> arg_offsets_ = std::vector<uint32_t>(1, 0);
+      detail::vector<string_ref> pos_args_;
+      std::vector<uint32_t> pos_offsets_ = std::vector<uint32_t>(1, 0);
+      detail::vector<std::pair<string_ref, string_ref>> params_;
+      std::vector<uint32_t> param_offsets_ = std::vector<uint32_t>(1, 0);
+      detail::vector<string_ref> flags_;
+      std::vector<uint32_t> flag_offsets_ = std::vector<uint32_t>(1, 0);
+
+      // keyed by (command, name)
+      detail::name_index params_index_;
+      detail::name_index flags_index_;
+
+      detail::name_set registered_;
+   };
+
+   // A view of one command line in a batch_parser, with the same accessors as parser.
+   // Valid while the batch_parser is alive and not re-parsed.
+   class batch_parser::command
+   {
+   public:
+      size_t size()                                    const { return owner_->pos_offsets_[index_ + 1] - owner_->pos_offsets_[index_]; }
+
+      bool operator[](string_ref name) const;
+      bool operator[](const std::vector<std::string>& init_list) const;
+      bool operator[](std::initializer_list<string_ref> init_list) const;
+      string_ref operator[](size_t ind) const;
+
+      string_stream operator()(size_t ind) const;
+      string_stream operator()(string_ref name) const;
+      string_stream operator()(const std::vector<std::string>& init_list) const;
+      string_stream operator()(std::initializer_list<string_ref> init_list) const;
+
+      template <typename T> bool get(size_t ind, T& value) const                                      { return ind < size() && detail::convert((*this)[ind], value); }
+      template <typename T> bool get(string_ref name, T& value) const;
+      template <typename T> bool get(const std::vector<std::string>& init_list, T& value) const;
+      template <typename T> bool get(std::initializer_list<string_ref> init_list, T& value) const;
+
+      template <typename T> T get_or(size_t ind, T def) const                                         { get(ind, def);       return def; }
+      template <typename T> T get_or(string_ref name, T def) const                                    { get(name, def);      return def; }
+      template <typename T> T get_or(const std::vector<std::string>& init_list, T def) const          { get(init_list, def); return def; }
+      template <typename T> T get_or(std::initializer_list<string_ref> init_list, T def) const        { get(init_list, def); return def; }
+
+   private:
+      friend class batch_parser;
+      command(batch_parser const& owner, size_t index) : owner_(&owner), index_(index) {}
+
+      // the first of names found as a param
+      template <typename Names>
+      uint32_t find_any_param(Names const& names) const
+      {
+         for (string_ref name : names)
+         {
+            auto pos = owner_->find_param(index_, name);
+            if (detail::name_index::npos != pos)
+               return pos;
+         }
+         return detail::name_index::npos;
+      }
+
+      batch_parser const* owner_;
+      size_t index_;
+   };
+
+   //////////////////////////////////////////////////////////////////////////
+
+   template <typename T>
+   bool batch_parser::command::get(string_ref name, T& value) const
+   {
+      auto pos = owner_->find_param(index_, name);
+      return detail::name_index::npos != pos && detail::convert(owner_->params_[pos].second, value);
+   }
+
+   template <typename T>
+   bool batch_parser::command::get(const std::vector<std::string>& init_list, T& value) const
+   {
+      auto pos = find_any_param(init_list);
+      return detail::name_index::npos != pos && detail::convert(owner_->params_[pos].second, value);
+   }
+
+   template <typename T>
+   bool batch_parser::command::get(std::initializer_list<string_ref> init_list, T& value) const
+   {
+      auto pos = find_any_param(init_list);
+      return detail::name_index::npos != pos && detail::convert(owner_->params_[pos].second, value);
+   }
+
+}
@@ -0,0 +1,782 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "argh.h"
+
+namespace
+{
+    // run fn() reps times and return the best wall time of a single run, in milliseconds
+    double best_ms(int reps, std::function<void()> const& fn)
+    {
+        double best = 0;
+        for (int r = 0; r < reps; ++r)
+        {
+            auto start = std::chrono::steady_clock::now();
+            fn();
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            if (0 == r || elapsed.count() < best)
+                best = elapsed.count();
+        }
+        return best;
+    }
+
+    void report(const char* name, size_t items, double ms)
+    {
+        std::printf("%-40s %10zu items %10.2f ms %10.1f ns/item\n", name, items, ms, ms * 1e6 / items);
+    }
+
+    // a long xargs-style command line: a few options, numbers and many file names
+    std::vector<std::string> make_corpus(size_t count)
+    {
+        std::vector<std::string> args{ "tool" };
+        for (size_t i = 1; i < count; ++i)
+        {
+            switch (i % 8)
+            {
+            case 0:  args.push_back("--level=" + std::to_string(i % 10)); break;
+            case 1:  args.push_back("-v");                                break;
+            case 2:  args.push_back("-" + std::to_string(i));             break;
+            case 3:  args.push_back("-1.5e3");                            break;
+            default: args.push_back("src/dir" + std::to_string(i % 97) + "/file" + std::to_string(i) + ".cpp"); break;
+            }
+        }
+        return args;
+    }
+
+    std::vector<const char*> make_argv(std::vector<std::string> const& corpus)
+    {
+        std::vector<const char*> argv;
+        for (auto& arg : corpus)
+            argv.push_back(arg.c_str());
+        argv.push_back(nullptr);
+        return argv;
+    }
+
+    // the classifier argh used before detail::is_number
+    bool stream_is_number(std::string const& arg)
+    {
+        std::istringstream istr(arg);
+        double number;
+        istr >> number;
+        return !(istr.fail() || istr.bad());
+    }
+
+    void bench_is_number(std::vector<std::string> const& corpus)
+    {
+        size_t hits = 0;
+        report("is_number (istringstream)", corpus.size(), best_ms(3, [&]
+        {
+            for (auto& arg : corpus)
+                hits += stream_is_number(arg);
+        }));
+        report("is_number (argh::detail)", corpus.size(), best_ms(3, [&]
+        {
+            for (auto& arg : corpus)
+                hits += argh::detail::is_number(arg);
+        }));
+        volatile size_t sink = hits; // keep the loops from being optimized away
+        (void)sink;
+    }
+
+    void bench_parse(std::vector<std::string> const& corpus)
+    {
+        auto argv = make_argv(corpus);
+        auto argc = static_cast<int>(corpus.size());
+        argh::parser cmdl;
+        report("parse", corpus.size(), best_ms(3, [&] { cmdl.parse(argc, argv.data()); }));
+        report("parse (NO_COPY_ARGV)", corpus.size(), best_ms(3, [&] { cmdl.parse(argc, argv.data(), argh::NO_COPY_ARGV); }));
+        report("parse (LAZY), never read", corpus.size(), best_ms(3, [&] { cmdl.parse(argc, argv.data(), argh::LAZY); }));
+        report("parse (LAZY) + first lookup", corpus.size(), best_ms(3, [&]
+        {
+            cmdl.parse(argc, argv.data(), argh::LAZY);
+            volatile bool sink = cmdl["v"];
+            (void)sink;
+        }));
+    }
+
+    // classification alone (detail::parse_args), without copying argv or indexing the results
+    void bench_classify(std::vector<std::string> const& corpus)
+    {
+        for (size_t count : { size_t(100000), corpus.size() })
+        {
+            std::vector<argh::string_ref> args(corpus.begin(), corpus.begin() + static_cast<ptrdiff_t>(std::min(count, corpus.size())));
+            argh::detail::name_set registered;
+            registered.insert("level");
+            argh::detail::vector<argh::string_ref> pos_args, flags;
+            argh::detail::vector<std::pair<argh::string_ref, argh::string_ref>> params;
+
+            char name[64];
+            std::snprintf(name, sizeof(name), "classify %zu args", args.size());
+            report(name, args.size(), best_ms(5, [&]
+            {
+                pos_args.clear();
+                params.clear();
+                flags.clear();
+                argh::detail::parse_args(args.data(), args.size(), argh::PREFER_FLAG_FOR_UNREG_OPTION, registered, pos_args, params, flags);
+            }));
+        }
+    }
+
+    void bench_lookup(std::vector<std::string> const& corpus)
+    {
+        auto argv = make_argv(corpus);
+        argh::parser cmdl(static_cast<int>(corpus.size()), argv.data());
+
+        const std::string names[] = { "v", "--level", "-missing", "x" };
+        const size_t lookups = 1000000;
+        size_t hits = 0;
+        report("flag + param lookup", lookups, best_ms(3, [&]
+        {
+            for (size_t i = 0; i < lookups; ++i)
+            {
+                auto& name = names[i % 4];
+                hits += cmdl[name];
+                hits += static_cast<bool>(cmdl(name));
+            }
+        }));
+        volatile size_t sink = hits;
+        (void)sink;
+    }
+
+    // an event loop checking the same four options over and over
+    void bench_handles()
+    {
+        const char* argv[] = { "server", "-v", "--trace", "--threads=16", "--scale=2.5", "--name=worker", nullptr };
+        argh::parser cmdl(argv);
+
+        const size_t lookups = 1000000;
+        long long sum = 0;
+        report("4 lookups by name", lookups, best_ms(3, [&]
+        {
+            for (size_t i = 0; i < lookups; ++i)
+            {
+                int n = 0;
+                cmdl.get("threads", n);
+                sum += n + cmdl["v"] + cmdl["trace"] + cmdl["quiet"];
+            }
+        }));
+
+        using namespace argh::literals;
+        report("4 lookups by _opt literal", lookups, best_ms(3, [&]
+        {
+            for (size_t i = 0; i < lookups; ++i)
+            {
+                int n = 0;
+                cmdl.get("threads"_opt, n);
+                sum += n + cmdl["v"_opt] + cmdl["trace"_opt] + cmdl["quiet"_opt];
+            }
+        }));
+
+        auto threads = cmdl.handle("threads");
+        auto verbose = cmdl.handle("v");
+        auto trace = cmdl.handle("trace");
+        auto quiet = cmdl.handle("quiet");
+        report("4 lookups by handle", lookups, best_ms(3, [&]
+        {
+            for (size_t i = 0; i < lookups; ++i)
+            {
+                int n = 0;
+                cmdl.get(threads, n);
+                sum += n + cmdl[verbose] + cmdl[trace] + cmdl[quiet];
+            }
+        }));
+        volatile long long sink = sum;
+        (void)sink;
+    }
+
+    void bench_aliases()
+    {
+        const char* argv[] = { "server", "--verbose", "--jobs=16", "--scale=2.5", nullptr };
+        argh::parser listed(argv);
+        argh::parser aliased;
+        aliased.add_aliases({ "v", "verbose" });
+        aliased.add_aliases({ "j", "threads", "jobs" });
+        aliased.parse(argv);
+
+        const size_t lookups = 1000000;
+        long long sum = 0;
+        report("2 lookups by name list", lookups, best_ms(3, [&]
+        {
+            for (size_t i = 0; i < lookups; ++i)
+            {
+                int n = 0;
+                listed.get({ "j", "threads", "jobs" }, n);
+                sum += n + listed[{ "v", "verbose" }];
+            }
+        }));
+        report("2 lookups by alias", lookups, best_ms(3, [&]
+        {
+            for (size_t i = 0; i < lookups; ++i)
+            {
+                int n = 0;
+                aliased.get("j", n);
+                sum += n + aliased["v"];
+            }
+        }));
+        volatile long long sink = sum;
+        (void)sink;
+    }
+
+    void bench_schema_lookup()
+    {
+        enum class opt { verbose, threads, scale, name };
+        static const argh::schema options({
+            { { "v", "verbose" }, false },
+            { { "j", "threads" }, true },
+            { { "s", "scale" }, true },
+            { { "n", "name" }, true },
+        });
+        const char* argv[] = { "server", "--threads=16", "--scale=2.5", "--name=worker", "-v", nullptr };
+        argh::parser by_name(argv);
+        argh::parser by_id(options);
+        by_id.parse(argv);
+
+        const size_t lookups = 1000000;
+        size_t hits = 0;
+        report("flag + param lookup by name", lookups, best_ms(3, [&]
+        {
+            for (size_t i = 0; i < lookups; ++i)
+                hits += by_name["verbose"] + by_name.get_or("threads", 0);
+        }));
+        report("flag + param lookup by schema id", lookups, best_ms(3, [&]
+        {
+            for (size_t i = 0; i < lookups; ++i)
+                hits += by_id[opt::verbose] + by_id.get_or(opt::threads, 0);
+        }));
+
+        const char* line[] = { "server", "-j", "16", "-s", "2.5", "--name", "worker", "-v", "in.txt", nullptr };
+        const size_t parses = 200000;
+        report("parse 8 args with a schema", parses, best_ms(3, [&]
+        {
+            for (size_t i = 0; i < parses; ++i)
+            {
+                by_id.parse(line);
+                hits += by_id.size();
+            }
+        }));
+        volatile size_t sink = hits;
+        (void)sink;
+    }
+
+    void bench_convert()
+    {
+        const char* argv[] = { "tool", "--threads=16", "--scale=2.5", nullptr };
+        argh::parser cmdl(argv);
+
+        const size_t lookups = 1000000;
+        long long sum = 0;
+        report("int param via operator() >>", lookups, best_ms(3, [&]
+        {
+            for (size_t i = 0; i < lookups; ++i)
+            {
+                int threads = 0;
+                cmdl("threads") >> threads;
+                sum += threads;
+            }
+        }));
+        report("int param via get<int>", lookups, best_ms(3, [&]
+        {
+            for (size_t i = 0; i < lookups; ++i)
+                sum += cmdl.get_or("threads", 0);
+        }));
+        report("double param via get<double>", lookups, best_ms(3, [&]
+        {
+            for (size_t i = 0; i < lookups; ++i)
+                sum += static_cast<long long>(cmdl.get_or("scale", 0.0));
+        }));
+        volatile long long sink = sum;
+        (void)sink;
+    }
+
+    // the way callers split a command line before parse(string_ref) existed
+    std::vector<std::string> split_words(std::string const& line)
+    {
+        std::vector<std::string> words;
+        std::string word;
+        bool in_word = false;
+        char quote = 0;
+        for (auto c : line)
+        {
+            if (quote)
+            {
+                if (c == quote)
+                    quote = 0;
+                else
+                    word += c;
+            }
+            else if ('\'' == c || '"' == c)
+            {
+                quote = c;
+                in_word = true;
+            }
+            else if (' ' == c)
+            {
+                if (in_word)
+                    words.push_back(word);
+                word.clear();
+                in_word = false;
+            }
+            else
+            {
+                word += c;
+                in_word = true;
+            }
+        }
+        if (in_word)
+            words.push_back(word);
+        return words;
+    }
+
+    void bench_command_line()
+    {
+        std::vector<std::string> lines;
+        for (size_t i = 0; i < 100000; ++i)
+            lines.push_back("/usr/bin/job" + std::to_string(i % 13) + " -v --user=u" + std::to_string(i % 101) +
+                            " --title='nightly build " + std::to_string(i) + "' -j " + std::to_string(i % 8) +
+                            " \"src dir/file" + std::to_string(i % 7) + ".txt\" out.txt");
+
+        argh::parser cmdl;
+        size_t verbose = 0;
+        report("split, then parse argv", lines.size(), best_ms(3, [&]
+        {
+            for (auto& line : lines)
+            {
+                auto words = split_words(line);
+                auto argv = make_argv(words);
+                cmdl.parse(static_cast<int>(words.size()), argv.data());
+                verbose += cmdl["v"];
+            }
+        }));
+        report("parse command line string", lines.size(), best_ms(3, [&]
+        {
+            for (auto& line : lines)
+            {
+                cmdl.parse(line);
+                verbose += cmdl["v"];
+            }
+        }));
+        volatile size_t sink = verbose;
+        (void)sink;
+    }
+
+    // long compiler invocations with quoted defines and an inline JSON value, a few KB each
+    void bench_tokenize_scanners()
+    {
+        std::vector<std::string> lines;
+        for (size_t i = 0; i < 1000; ++i)
+        {
+            std::string line = "/usr/bin/c++ -std=c++17 -O2";
+            for (size_t k = 0; k < 40; ++k)
+                line += " -I/home/build/workspace/project/third_party/library" + std::to_string(k) + "/include";
+            line += " -DVERSION=\"1.2." + std::to_string(i) + "\" --config='{\"name\": \"job\", \"retries\": 3, \"tags\": [\"a\", \"b\"]}'";
+            line += " -c src/module" + std::to_string(i) + ".cpp -o obj/module" + std::to_string(i) + ".o";
+            lines.push_back(line);
+        }
+
+        argh::detail::vector<argh::string_ref> args;
+        argh::detail::vector<char> buffer;
+        const std::pair<argh::detail::scanner, const char*> scanners[] = {
+            { argh::detail::scanner::scalar, "tokenize (scalar)" },
+            { argh::detail::scanner::sse2,   "tokenize (sse2)" },
+            { argh::detail::scanner::avx2,   "tokenize (avx2)" },
+        };
+        size_t bytes = 0;
+        for (auto& line : lines)
+            bytes += line.size();
+        for (auto& scanner : scanners)
+        {
+            if (scanner.first > argh::detail::best_scanner())
+                continue;
+            report(scanner.second, bytes, best_ms(5, [&]
+            {
+                for (auto& line : lines)
+                    argh::detail::tokenize(line, args, buffer, scanner.first);
+            }));
+        }
+    }
+
+    // a linker response file with tens of thousands of object files
+    void bench_response_file()
+    {
+        const char* path = "argh_bench.rsp";
+        std::string contents;
+        const size_t count = 50000;
+        for (size_t i = 0; i < count; ++i)
+            contents += "obj/dir" + std::to_string(i % 97) + "/module" + std::to_string(i) + ".o\n";
+        contents += "-o 'out dir/app' -L/usr/lib -lpthread\n";
+        if (auto file = std::fopen(path, "wb"))
+        {
+            std::fwrite(contents.data(), 1, contents.size(), file);
+            std::fclose(file);
+        }
+
+        const char* argv[] = { "ld", "@argh_bench.rsp", nullptr };
+        argh::parser cmdl;
+        report("parse with @file expansion", count, best_ms(5, [&] { cmdl.parse(argv, argh::EXPAND_RESPONSE_FILES); }));
+        std::remove(path);
+    }
+
+    // an xargs-style wrapper: a few options, then 100k file names after "--"
+    void bench_double_dash_tail()
+    {
+        std::vector<std::string> words = { "wrap", "-v", "--jobs=8", "--" };
+        for (size_t i = 0; i < 100000; ++i)
+            words.push_back("src/module" + std::to_string(i % 97) + "/file-" + std::to_string(i) + ".cpp");
+        auto argv = make_argv(words);
+        auto argc = static_cast<int>(words.size());
+
+        argh::parser cmdl;
+        report("parse whole line (NO_COPY_ARGV)", words.size(), best_ms(3, [&] { cmdl.parse(argc, argv.data(), argh::NO_COPY_ARGV); }));
+        report("STOP_AT_DOUBLE_DASH (NO_COPY_ARGV)", words.size(), best_ms(3, [&]
+        {
+            cmdl.parse(argc, argv.data(), argh::NO_COPY_ARGV | argh::STOP_AT_DOUBLE_DASH);
+            volatile size_t sink = cmdl.tail().size();
+            (void)sink;
+        }));
+    }
+
+    // tar-style clusters of single character flags, and lookups of them
+    void bench_multiflag()
+    {
+        std::vector<std::string> words = { "tar" };
+        for (size_t i = 0; i < 1000; ++i)
+            words.push_back(i % 2 ? "-xvzf" : "-cjvpS");
+        auto argv = make_argv(words);
+        auto argc = static_cast<int>(words.size());
+
+        argh::parser cmdl;
+        report("parse SINGLE_DASH_IS_MULTIFLAG", words.size(), best_ms(3, [&]
+        {
+            for (int i = 0; i < 100; ++i)
+                cmdl.parse(argc, argv.data(), argh::SINGLE_DASH_IS_MULTIFLAG);
+        }) / 100);
+
+        const char* names[] = { "v", "z", "q", "-x" };
+        const size_t lookups = 1000000;
+        size_t hits = 0;
+        report("single character flag lookup", lookups, best_ms(3, [&]
+        {
+            for (size_t i = 0; i < lookups; ++i)
+                hits += cmdl[names[i % 4]];
+        }));
+        volatile size_t sink = hits;
+        (void)sink;
+    }
+
+    // generated tools registering huge param sets in one add_params() call
+    void bench_registry()
+    {
+        std::vector<std::string> words = { "tool", "--param-7", "x", "--param-5000", "y", "--unknown", "z", "file" };
+        auto argv = make_argv(words);
+        auto argc = static_cast<int>(words.size());
+
+        for (size_t registered : { 10u, 1000u, 100000u, 1000000u })
+        {
+            std::vector<std::string> names;
+            for (size_t i = 0; i < registered; ++i)
+                names.push_back("--param-" + std::to_string(i));
+
+            char name[64];
+            std::snprintf(name, sizeof(name), "add_param() x %zu", registered);
+            report(name, registered, best_ms(3, [&]
+            {
+                argh::parser cmdl;
+                for (auto& param : names)
+                    cmdl.add_param(param);
+            }));
+            std::snprintf(name, sizeof(name), "add_params(%zu names)", registered);
+            report(name, registered, best_ms(3, [&] { argh::parser cmdl(names); }));
+
+            argh::parser cmdl(names);
+            const size_t count = 100000;
+            size_t found = 0;
+            std::snprintf(name, sizeof(name), "parse, %zu registered", registered);
+            report(name, count, best_ms(3, [&]
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    cmdl.parse(argc, argv.data());
+                    found += static_cast<bool>(cmdl("param-7"));
+                }
+            }));
+            volatile size_t sink = found;
+            (void)sink;
+        }
+    }
+
+    // resolving "--opt-4-verb" to "--opt-4-verbose", with ever more params registered
+    void bench_abbreviations()
+    {
+        std::vector<std::string> words = { "tool", "--opt-4-verb", "1", "--opt-7-col=auto", "--opt-9-wid", "80", "file" };
+        auto argv = make_argv(words);
+        auto argc = static_cast<int>(words.size());
+
+        for (size_t registered : { 10u, 1000u, 100000u })
+        {
+            argh::parser cmdl;
+            for (size_t i = 0; i < registered; ++i)
+            {
+                auto prefix = "opt-" + std::to_string(i % 10) + (i < 10 ? "" : "-" + std::to_string(i));
+                cmdl.add_params({ prefix + "-verbose", prefix + "-color", prefix + "-width" });
+            }
+            cmdl.parse(argc, argv.data(), argh::ALLOW_ABBREVIATIONS); // builds the index
+
+            const size_t count = 100000;
+            size_t found = 0;
+            char name[64];
+            std::snprintf(name, sizeof(name), "abbreviated parse, %zu x 3 registered", registered);
+            report(name, count, best_ms(3, [&]
+            {
+                for (size_t i = 0; i < count; ++i)
+                {
+                    cmdl.parse(argc, argv.data(), argh::ALLOW_ABBREVIATIONS);
+                    found += static_cast<bool>(cmdl("opt-4-verbose"));
+                }
+            }));
+            volatile size_t sink = found;
+            (void)sink;
+        }
+    }
+
+    // a unified CLI with 120 subcommands ("group3 cmd7"), each with its own params
+    void bench_router()
+    {
+        std::vector<argh::router::command> commands;
+        for (size_t group = 0; group < 12; ++group)
+        {
+            for (size_t cmd = 0; cmd < 10; ++cmd)
+            {
+                argh::router::command command;
+                command.path = "group" + std::to_string(group) + " cmd" + std::to_string(cmd);
+                for (size_t param = 0; param < 12; ++param)
+                    command.params.push_back("param" + std::to_string(param) + "-of-" + std::to_string(cmd));
+                commands.push_back(command);
+            }
+        }
+        std::vector<std::string> words = { "tool", "group11", "cmd9", "--param3-of-9", "x", "-v", "file" };
+        auto argv = make_argv(words);
+        auto argc = static_cast<int>(words.size());
+
+        const size_t count = 10000;
+        size_t found = 0;
+        report("parser per subcommand, until one fits", count, best_ms(3, [&]
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                for (auto& command : commands)
+                {
+                    argh::parser cmdl(command.params);
+                    cmdl.parse(argc, argv.data());
+                    if (command.path == std::string(cmdl[1]) + ' ' + std::string(cmdl[2]))
+                    {
+                        found += cmdl["v"];
+                        break;
+                    }
+                }
+            }
+        }));
+        report("router, built per invocation", count, best_ms(3, [&]
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                argh::router tool(commands);
+                found += tool.route(argc, argv.data());
+            }
+        }));
+        argh::router tool(commands);
+        report("router, built once", count, best_ms(3, [&]
+        {
+            for (size_t i = 0; i < count; ++i)
+                found += tool.route(argc, argv.data());
+        }));
+        volatile size_t sink = found;
+        (void)sink;
+    }
+
+    // a process-inspection agent: one /proc/<pid>/cmdline after another
+    void bench_nul_delimited()
+    {
+        std::string cmdline;
+        for (size_t i = 0; i < 20; ++i)
+            cmdline += "--option" + std::to_string(i) + "=value" + std::to_string(i) + '\0';
+        cmdline += std::string("/usr/lib/service/bin/daemon\0-v\0--config\0/etc/service.conf\0", 58);
+
+        argh::parser cmdl;
+        const size_t count = 100000;
+        report("build argv, then parse", count, best_ms(3, [&]
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                std::vector<const char*> argv;
+                for (size_t pos = 0; pos < cmdline.size(); pos += std::strlen(cmdline.data() + pos) + 1)
+                    argv.push_back(cmdline.data() + pos);
+                cmdl.parse(static_cast<int>(argv.size()), argv.data());
+            }
+        }));
+        report("parse_nul_delimited (NO_COPY_ARGV)", count, best_ms(3, [&]
+        {
+            for (size_t i = 0; i < count; ++i)
+                cmdl.parse_nul_delimited(cmdline.data(), cmdline.size(), argh::NO_COPY_ARGV);
+        }));
+        report("parse_self_cmdline", 10000, best_ms(3, [&]
+        {
+            for (size_t i = 0; i < 10000; ++i)
+                cmdl.parse_self_cmdline();
+        }));
+    }
+
+    // many short recorded command lines, as in an audit log
+    std::vector<std::vector<std::string>> make_command_lines(size_t count)
+    {
+        std::vector<std::vector<std::string>> lines;
+        for (size_t i = 0; i < count; ++i)
+        {
+            std::vector<std::string> line{ "/usr/bin/tool" + std::to_string(i % 13), "-v", "--user=u" + std::to_string(i % 101) };
+            for (size_t k = 0; k < i % 7; ++k)
+                line.push_back("file" + std::to_string(k) + ".txt");
+            line.push_back("-j");
+            line.push_back(std::to_string(i % 8));
+            lines.push_back(line);
+        }
+        return lines;
+    }
+
+    void bench_batch()
+    {
+        auto lines = make_command_lines(100000);
+        std::vector<std::vector<const char*>> argvs;
+        for (auto& line : lines)
+            argvs.push_back(make_argv(line));
+        std::vector<const char* const*> argv_ptrs;
+        for (auto& argv : argvs)
+            argv_ptrs.push_back(argv.data());
+
+        size_t verbose = 0;
+        report("parser per command line", lines.size(), best_ms(3, [&]
+        {
+            for (auto argv : argv_ptrs)
+            {
+                argh::parser cmdl(argv);
+                verbose += cmdl["v"];
+            }
+        }));
+
+        argh::batch_parser batch;
+        report("batch_parser", lines.size(), best_ms(3, [&]
+        {
+            batch.parse(argv_ptrs);
+            for (size_t i = 0; i < batch.size(); ++i)
+                verbose += batch[i]["v"];
+        }));
+        volatile size_t sink = verbose;
+        (void)sink;
+    }
+
+    // a large corpus of command lines split over 1..N worker threads
+    void bench_parallel_batch()
+    {
+        auto lines = make_command_lines(1000000);
+        std::vector<std::vector<const char*>> argvs;
+        for (auto& line : lines)
+            argvs.push_back(make_argv(line));
+        std::vector<const char* const*> argv_ptrs;
+        for (auto& argv : argvs)
+            argv_ptrs.push_back(argv.data());
+
+        argh::batch_parser batch;
+        auto max_threads = std::max(1u, std::thread::hardware_concurrency());
+        double single = 0;
+        for (unsigned threads = 1; threads <= max_threads; threads *= 2)
+        {
+            auto ms = best_ms(3, [&] { batch.parse_parallel(argv_ptrs, threads); });
+            if (1 == threads)
+                single = ms;
+
+            char name[64];
+            std::snprintf(name, sizeof(name), "batch_parser, %u threads", threads);
+            report(name, lines.size(), ms);
+            std::printf("%-40s %10.2fx\n", "  speedup vs 1 thread", single / ms);
+        }
+    }
+
+    // many threads reading one shared, already parsed, parser
+    void bench_concurrent_reads()
+    {
+        const char* argv[] = { "server", "--threads=16", "--scale=2.5", "--name=worker", "-v", nullptr };
+        const argh::parser cmdl(argv);
+
+        const size_t lookups = 1000000;
+        auto max_threads = std::max(1u, std::thread::hardware_concurrency());
+        double single = 0;
+        for (unsigned threads = 1; threads <= max_threads; threads *= 2)
+        {
+            auto ms = best_ms(3, [&]
+            {
+                std::vector<std::thread> pool;
+                for (unsigned t = 0; t < threads; ++t)
+                {
+                    pool.emplace_back([&]
+                    {
+                        long long sum = 0;
+                        for (size_t i = 0; i < lookups; ++i)
+                        {
+                            int n = 0;
+                            double scale = 0;
+                            cmdl("threads") >> n;
+                            cmdl("scale") >> scale;
+                            sum += n + static_cast<long long>(scale) + cmdl["v"];
+                        }
+                        volatile long long sink = sum;
+                        (void)sink;
+                    });
+                }
+                for (auto& worker : pool)
+                    worker.join();
+            });
+            if (1 == threads)
+                single = ms;
+
+            char name[64];
+            std::snprintf(name, sizeof(name), "concurrent reads, %u threads", threads);
+            report(name, lookups * threads, ms);
+            std::printf("%-40s %10.2fx\n", "  speedup vs 1 thread", single * threads / ms);
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    // optional first argument: number of arguments in the synthetic command line
+    size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    auto corpus = make_corpus(count);
+
+    bench_is_number(corpus);
+    bench_parse(corpus);
+    bench_classify(corpus);
+    bench_lookup(corpus);
+    bench_schema_lookup();
+    bench_handles();
+    bench_aliases();
+    bench_convert();
+    bench_command_line();
+    bench_tokenize_scanners();
+    bench_response_file();
+    bench_nul_delimited();
+    bench_double_dash_tail();
+    bench_multiflag();
+    bench_registry();
+    bench_abbreviations();
+    bench_router();
+    bench_batch();
+    bench_parallel_batch();
+    bench_concurrent_reads();
+
+    return EXIT_SUCCESS;
+}
@@ -1,5 +1,13 @@
 #include "argh.h"
 
+#include <atomic>
+#include <clocale>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <thread>
+
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include "doctest.h"
 
@@ -537,3 +545,1341 @@ TEST_CASE("Test parsing multiple with add_param") {
   CHECK(cmdl({"a", "b", "c"}));
   CHECK(fixture == cmdl("a").str());
 }
+
+TEST_CASE("Test NO_COPY_ARGV references argv") {
+  const char* argv[] = {"0", "-a", "1", "--b=2", "-c", "3", nullptr};
+  parser cmdl(argv, argh::PREFER_PARAM_FOR_UNREG_OPTION | argh::NO_COPY_ARGV);
+
+  CHECK(1 == cmdl.size());
+  CHECK(cmdl.pos_view(0).data() == argv[0]);
+  CHECK(cmdl("a").str() == "1");
+  CHECK(cmdl("b").str() == "2");
+  CHECK(cmdl("c").str() == "3");
+
+  // a copy keeps referencing the same argv
+  auto copy = cmdl;
+  CHECK(copy.pos_view(0).data() == argv[0]);
+  CHECK(copy("b").str() == "2");
+}
+
+TEST_CASE("Test args are copied by default") {
+  char arg0[] = "zero";
+  char arg1[] = "--name=value";
+  const char* argv[] = {arg0, arg1, nullptr};
+  parser cmdl(argv);
+  auto copy = cmdl;
+
+  arg0[0] = 'X';
+  arg1[7] = 'X';
+  CHECK(cmdl[0] == "zero");
+  CHECK(cmdl.pos_view(0).data() != arg0);
+  CHECK(cmdl("name").str() == "value");
+  CHECK(copy[0] == "zero");
+  CHECK(copy("name").str() == "value");
+
+  // re-parsing one parser does not affect its copies
+  const char* other[] = {"other", nullptr};
+  cmdl.parse(other);
+  CHECK(cmdl[0] == "other");
+  CHECK(copy[0] == "zero");
+}
+
+TEST_CASE("Test is_number matches std::istream") {
+  // the reference: what an std::istringstream extracting a double accepts
+  auto stream_is_number = [](std::string const& arg) {
+    std::istringstream istr(arg);
+    double number;
+    istr >> number;
+    return !(istr.fail() || istr.bad());
+  };
+
+  const char* fixed[] = {
+      "", "-", "+", ".", "-.", "e", "-e5", "0", "-0", "-1", "+1", "1.",
+      ".5", "-.5", "5.e3", "1e", "1e+", "1e-", "1e5", "1E-5", "1ex", "1e+x",
+      "1e5e", "1.2.3", "0x1A", "-0x", "-7abc", " 5", "\t-5", "  ", "- 5",
+      "+-5", "--5", "1,5", "inf", "-inf", "nan", "1e308", "1.7976931348623157e308",
+      "1.7976931348623158e308", "1.7976931348623159e308", "-1.8e308", "2e308",
+      "0.1e309", "10e307", "1e309", "-1e309", "1e-400", "0e99999", "0.0e99999",
+      "1e99999999999999999999", "1e-99999999999999999999", "00000000000001e308",
+      "0.00000000000001e322", "179769313486231580793728971405303415079934132710037826936173778980444968292764750946649017977587207096330286416692887910946555547851940402630657488671505820681908902000708383676273854845817711531764475730270069855571366959622842914819860834936475292719074168444365510704342711559699508093042880177904174497791"};
+  for (auto arg : fixed) {
+    INFO(arg);
+    CHECK(stream_is_number(arg) == argh::detail::is_number(arg));
+  }
+
+  // random strings over the characters the number grammar cares about
+  const char alphabet[] = "0123456789+-.eE x";
+  unsigned seed = 12345;
+  for (int i = 0; i < 20000; ++i) {
+    std::string arg;
+    seed = seed * 1103515245u + 12345u;
+    auto len = (seed >> 16) % 9;
+    for (unsigned k = 0; k < len; ++k) {
+      seed = seed * 1103515245u + 12345u;
+      arg += alphabet[(seed >> 16) % (sizeof(alphabet) - 1)];
+    }
+    INFO(arg);
+    CHECK(stream_is_number(arg) == argh::detail::is_number(arg));
+  }
+}
+
+TEST_CASE("Test repeated options keep first value") {
+  const char* argv[] = {"-a", "1", "--a", "2", "-f", "-f", "--a=3", nullptr};
+  parser cmdl(argv, argh::PREFER_PARAM_FOR_UNREG_OPTION);
+
+  CHECK(cmdl("a").str() == "1");
+  CHECK(cmdl("-a").str() == "1");
+  CHECK(cmdl({"x", "y", "--a"}).str() == "1");
+  CHECK(cmdl["f"]);
+  CHECK(!cmdl["a"]);
+}
+
+TEST_CASE("Test many options") {
+  std::vector<std::string> args;
+  for (int i = 0; i < 1000; ++i) {
+    args.push_back("--flag" + std::to_string(i));
+    args.push_back("--param" + std::to_string(i) + "=" + std::to_string(i));
+  }
+  std::vector<const char*> argv;
+  for (auto& arg : args) argv.push_back(arg.c_str());
+  argv.push_back(nullptr);
+
+  parser cmdl;
+  for (int i = 0; i < 1000; i += 2) cmdl.add_param("reg" + std::to_string(i));
+  cmdl.parse(argv.data());
+
+  for (int i = 0; i < 1000; ++i) {
+    CHECK(cmdl["flag" + std::to_string(i)]);
+    CHECK(cmdl("param" + std::to_string(i)).str() == std::to_string(i));
+    CHECK(!cmdl["param" + std::to_string(i)]);
+    CHECK(!cmdl("flag" + std::to_string(i)));
+  }
+  CHECK(!cmdl["flag1000"]);
+  CHECK(!cmdl("param1000"));
+}
+
+TEST_CASE("Test typed accessors") {
+  const char* argv[] = {"app",        "42",          "--int=-17",  "--big=99999999999",
+                        "--u=4000000000", "--neg=-1",   "--pi=3.25",  "--huge=1e400",
+                        "--bool=1",   "--char=x",    "--text=a b", "--bad=12abc",
+                        "--min=-2147483648", nullptr};
+  parser cmdl(argv);
+
+  int i = 0;
+  CHECK(cmdl.get("int", i));
+  CHECK(i == -17);
+  CHECK(cmdl.get(1, i));
+  CHECK(i == 42);
+  CHECK(!cmdl.get("big", i));
+  CHECK(i == 42);
+  CHECK(!cmdl.get("bad", i));
+  CHECK(!cmdl.get("missing", i));
+  CHECK(!cmdl.get(10, i));
+  CHECK(i == 42);
+  CHECK(cmdl.get("min", i));
+  CHECK(i == std::numeric_limits<int>::min());
+
+  long long ll = 0;
+  CHECK(cmdl.get("big", ll));
+  CHECK(ll == 99999999999LL);
+
+  unsigned u = 0;
+  CHECK(cmdl.get("u", u));
+  CHECK(u == 4000000000u);
+  CHECK(!cmdl.get("neg", u));
+  unsigned short us = 0;
+  CHECK(!cmdl.get("u", us));
+
+  double d = 0;
+  CHECK(cmdl.get("pi", d));
+  CHECK(d == 3.25);
+  CHECK(!cmdl.get("huge", d));
+  CHECK(!cmdl.get("text", d));
+  float f = 0;
+  CHECK(cmdl.get("pi", f));
+  CHECK(f == 3.25f);
+
+  bool b = false;
+  CHECK(cmdl.get("bool", b));
+  CHECK(b);
+  CHECK(!cmdl.get("int", b));
+
+  char c = 0;
+  CHECK(cmdl.get("char", c));
+  CHECK(c == 'x');
+  CHECK(!cmdl.get("text", c));
+
+  std::string s;
+  CHECK(cmdl.get("text", s));
+  CHECK(s == "a b");
+  string_ref ref;
+  CHECK(cmdl.get({"x", "y", "text"}, ref));
+  CHECK(ref == "a b");
+
+  CHECK(cmdl.get_or("int", 5) == -17);
+  CHECK(cmdl.get_or("missing", 5) == 5);
+  CHECK(cmdl.get_or("bad", 5) == 5);
+  CHECK(cmdl.get_or(1, 0u) == 42u);
+  CHECK(cmdl.get_or({"missing", "x", "pi"}, 0.0) == 3.25);
+  CHECK(cmdl.get_or<std::string>("missing", "default") == "default");
+}
+
+template <typename T>
+static void check_extraction_matches_stream(std::string const& str,
+                                            T initial = T()) {
+  std::istringstream stream(str);
+  argh::stringstream_proxy proxy(str);
+  for (int i = 0; i < 2; ++i) {
+    T from_stream = initial, from_proxy = initial;
+    stream >> from_stream;
+    proxy >> from_proxy;
+    CHECK(stream.fail() == !proxy);
+    CHECK(from_stream == from_proxy);
+  }
+}
+
+TEST_CASE("Test stringstream_proxy extraction matches std::istream") {
+  const char* fixed[] = {"", " ", "0", "1", "2", "-1", "+5", "42 17", " 3.5e2x",
+                         "abc", "-", "1e", "1e400", "-1e400", "1e39", "70000",
+                         "-70000", "4294967296", "99999999999999999999", "-9223372036854775808",
+                         "0x10", "007", "1.5.5", "x y", "\t\n7"};
+  for (auto str : fixed) {
+    INFO(str);
+    check_extraction_matches_stream<bool>(str);
+    check_extraction_matches_stream<char>(str);
+    check_extraction_matches_stream<short>(str);
+    check_extraction_matches_stream<int>(str);
+    check_extraction_matches_stream<long>(str);
+    check_extraction_matches_stream<long long>(str);
+    check_extraction_matches_stream<unsigned char>(str);
+    check_extraction_matches_stream<unsigned short>(str);
+    check_extraction_matches_stream<unsigned int>(str);
+    check_extraction_matches_stream<unsigned long>(str);
+    check_extraction_matches_stream<unsigned long long>(str);
+    check_extraction_matches_stream<float>(str);
+    check_extraction_matches_stream<double>(str);
+    check_extraction_matches_stream<std::string>(str, "untouched");
+  }
+}
+
+TEST_CASE("Test float conversion ignores LC_NUMERIC") {
+  // any locale whose decimal point is not '.' will do; the check is skipped when none is installed
+  const char* names[] = {"de_DE.UTF-8", "de_DE.utf8", "de_DE", "fr_FR.UTF-8", "fr_FR.utf8", "ru_RU.UTF-8"};
+  std::string previous = std::setlocale(LC_NUMERIC, nullptr);
+  bool switched = false;
+  for (auto name : names)
+    if (std::setlocale(LC_NUMERIC, name) && std::string(".") != std::localeconv()->decimal_point) {
+      switched = true;
+      break;
+    }
+
+  const char* argv[] = {"prog", "-x=3.25", "-y=3,25"};
+  parser cmdl(3, argv);
+  double d = 0;
+  CHECK(cmdl.get("x", d));
+  CHECK(d == 3.25);
+  CHECK(!cmdl.get("y", d));
+  float f = 0;
+  CHECK((cmdl("x") >> f));
+  CHECK(f == 3.25f);
+  CHECK((cmdl("y") >> d));
+  CHECK(d == 3);
+
+  std::setlocale(LC_NUMERIC, previous.c_str());
+  if (!switched)
+    MESSAGE("no locale with a ',' decimal point installed, checked the classic locale only");
+}
+
+TEST_CASE("Test batch parser matches parser") {
+  const char* cmd0[] = {"ls", "-l", "--color=auto", "dir", nullptr};
+  const char* cmd1[] = {"gcc", "-O2", "-o", "out", "main.c", "-xvf", nullptr};
+  const char* cmd2[] = {nullptr};
+  const char* cmd3[] = {"tar", "-xvf", "archive.tar", "-o", "-1", nullptr};
+  std::vector<const char* const*> argvs{cmd0, cmd1, cmd2, cmd3};
+
+  int modes[] = {argh::PREFER_FLAG_FOR_UNREG_OPTION,
+                 argh::PREFER_PARAM_FOR_UNREG_OPTION,
+                 argh::SINGLE_DASH_IS_MULTIFLAG | argh::NO_COPY_ARGV};
+  const char* names[] = {"l", "color", "O2", "o", "x", "v", "f", "xvf", "1", "missing"};
+
+  for (int mode : modes) {
+    batch_parser batch({"o"});
+    batch.parse(argvs, mode);
+    REQUIRE(batch.size() == argvs.size());
+
+    for (size_t c = 0; c < argvs.size(); ++c) {
+      parser single({"o"});
+      single.parse(argvs[c], mode);
+      auto command = batch[c];
+
+      CHECK(command.size() == single.size());
+      for (size_t i = 0; i <= single.size(); ++i) {
+        CHECK(command[i] == single[i]);
+        CHECK(command(i).str() == single(i).str());
+      }
+      for (auto name : names) {
+        CHECK(command[name] == single[name]);
+        CHECK(command(name).str() == single(name).str());
+        CHECK(static_cast<bool>(command(name)) == static_cast<bool>(single(name)));
+      }
+      CHECK(command.get_or({"x", "y", "o"}, -5) == single.get_or({"x", "y", "o"}, -5));
+    }
+  }
+}
+
+TEST_CASE("Test batch parser on a NUL delimited buffer") {
+  const char buffer[] = "app\0-v\0--n=1\0\0other\0--n=2\0pos\0\0\0last\0-q";
+  batch_parser batch;
+  batch.parse_nul_delimited(buffer, sizeof(buffer) - 1, argh::NO_COPY_ARGV);
+
+  REQUIRE(batch.size() == 4);
+  CHECK(batch[0][0] == "app");
+  CHECK(batch[0][0].data() == buffer);
+  CHECK(batch[0]["v"]);
+  CHECK(batch[0].get_or("n", 0) == 1);
+  CHECK(!batch[1]["v"]);
+  CHECK(batch[1].get_or("n", 0) == 2);
+  CHECK(batch[1][1] == "pos");
+  CHECK(batch[2].size() == 0);
+  CHECK(batch[3][0] == "last");
+  CHECK(batch[3]["q"]);
+}
+
+TEST_CASE("Test parallel batch parser matches sequential batch parser and parser") {
+  std::vector<std::vector<std::string>> lines;
+  for (size_t i = 0; i < 300; ++i) {
+    std::vector<std::string> line{"tool" + std::to_string(i % 7)};
+    for (size_t k = 0; k < (i * 7919) % 23; ++k) {
+      switch ((i + k) % 7) {
+      case 0: line.push_back("-v"); break;
+      case 1: line.push_back("--level=" + std::to_string(k)); break;
+      case 2: line.push_back("-o"); break;
+      case 3: line.push_back("-" + std::to_string(k)); break;
+      case 4: line.push_back("-xz"); break;
+      case 5: line.push_back("--"); break;
+      default: line.push_back("file" + std::to_string(k)); break;
+      }
+    }
+    lines.push_back(line);
+  }
+  std::vector<std::vector<const char*>> argvs;
+  for (auto& line : lines) {
+    argvs.emplace_back();
+    for (auto& arg : line)
+      argvs.back().push_back(arg.c_str());
+    argvs.back().push_back(nullptr);
+  }
+  std::vector<const char* const*> argv_ptrs;
+  for (auto& argv : argvs)
+    argv_ptrs.push_back(argv.data());
+
+  const char* names[] = {"v", "level", "o", "x", "z", "xz", "1", "file1", "missing"};
+  for (int bits = 0; bits < 128; ++bits) {
+    // the five lowest mode bits, and the stopping points
+    int mode = (bits & 31) | (bits & 32 ? int(argh::STOP_AT_DOUBLE_DASH) : 0) |
+               (bits & 64 ? int(argh::STOP_AT_FIRST_POSITIONAL) : 0);
+    if ((mode & argh::PREFER_FLAG_FOR_UNREG_OPTION) && (mode & argh::PREFER_PARAM_FOR_UNREG_OPTION))
+      continue;
+    batch_parser sequential({"o"});
+    sequential.parse(argv_ptrs, mode);
+    REQUIRE(sequential.size() == argv_ptrs.size());
+
+    // the sequential batch against parser::parse, for every combination of modes
+    for (size_t c = 0; c < argv_ptrs.size(); ++c) {
+      parser single({"o"});
+      single.parse(argv_ptrs[c], mode);
+      auto command = sequential[c];
+      REQUIRE(command.size() == single.size());
+      for (size_t i = 0; i < single.size(); ++i)
+        CHECK(command[i] == single[i]);
+      for (auto name : names) {
+        CHECK(command[name] == single[name]);
+        CHECK(command(name).str() == single(name).str());
+      }
+    }
+
+    for (unsigned threads : {0u, 1u, 2u, 3u, 8u}) {
+      batch_parser parallel({"o"});
+      parallel.parse_parallel(argv_ptrs, threads, mode);
+      REQUIRE(parallel.size() == sequential.size());
+
+      for (size_t c = 0; c < sequential.size(); ++c) {
+        auto expected = sequential[c];
+        auto actual = parallel[c];
+        REQUIRE(actual.size() == expected.size());
+        for (size_t i = 0; i < expected.size(); ++i)
+          CHECK(actual[i] == expected[i]);
+        for (auto name : names) {
+          CHECK(actual[name] == expected[name]);
+          CHECK(actual(name).str() == expected(name).str());
+        }
+      }
+    }
+  }
+}
+
+namespace {
+// counts what goes through it, taking the memory from new/delete
+class counting_resource : public argh::memory_resource {
+public:
+  size_t allocations = 0;
+  size_t deallocations = 0;
+  size_t bytes = 0;
+
+protected:
+  void* do_allocate(size_t size, size_t alignment) override {
+    ++allocations;
+    bytes += size;
+    return argh::new_delete_resource()->allocate(size, alignment);
+  }
+  void do_deallocate(void* p, size_t size, size_t alignment) override {
+    ++deallocations;
+    argh::new_delete_resource()->deallocate(p, size, alignment);
+  }
+};
+} // namespace
+
+// Heap allocations made anywhere in the process, e.g. by a temporary std::string, which a memory_resource
+// cannot see. Replaces the whole C++11 new/delete family, so that every form pairs with its own.
+namespace {
+std::atomic<size_t> global_allocations{0};
+
+void* counted_malloc(size_t size) {
+  ++global_allocations;
+  return std::malloc(size ? size : 1);
+}
+} // namespace
+
+// GCC pairs the free() in the replaced operator delete with the operator new it inlines into, rather than
+// with the malloc() inside the replaced operator new, and warns about a mismatch that is not there.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void* operator new(size_t size) {
+  if (void* p = counted_malloc(size))
+    return p;
+  throw std::bad_alloc();
+}
+void* operator new[](size_t size) { return ::operator new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return counted_malloc(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return counted_malloc(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+TEST_CASE("Test parser storage comes from its memory resource") {
+  const char* argv[] = {"app", "-v", "--threads=4", "-o", "out.txt", "file.txt", nullptr};
+  counting_resource counter;
+  {
+    parser cmdl(&counter);
+    CHECK(cmdl.resource() == &counter);
+    cmdl.add_param("o");
+    cmdl.parse(argv);
+    CHECK(counter.allocations > 0);
+
+    auto allocations = counter.allocations;
+    CHECK(cmdl["v"]);
+    CHECK(cmdl("o").str() == "out.txt");
+    int threads = 0;
+    CHECK((cmdl("threads") >> threads));
+    CHECK(4 == threads);
+    CHECK(cmdl.pos_view(1) == "file.txt");
+    CHECK(allocations == counter.allocations);
+    // operator[] builds its string once, from the resource as well
+    CHECK(cmdl[1] == "file.txt");
+    CHECK(&cmdl[1] == &cmdl[1]);
+    CHECK(allocations + 1 == counter.allocations);
+
+    parser copy(cmdl);
+    CHECK(copy.resource() == &counter);
+    CHECK(copy("o").str() == "out.txt");
+  }
+  CHECK(counter.allocations == counter.deallocations);
+}
+
+TEST_CASE("Test monotonic_resource") {
+  const char* argv[] = {"app", "-v", "--name=value", "pos", nullptr};
+  alignas(16) char buffer[4096];
+  counting_resource upstream;
+  {
+    monotonic_resource arena(buffer, sizeof(buffer), &upstream);
+    parser cmdl(&arena);
+    cmdl.add_params({"a", "b", "c"});
+    cmdl.parse(argv);
+    CHECK(cmdl["v"]);
+    CHECK(cmdl("name").str() == "value");
+    CHECK(cmdl[1] == "pos");
+    // everything fits in the buffer, including the copied characters
+    CHECK(cmdl.pos_view(1).data() >= buffer);
+    CHECK(cmdl.pos_view(1).data() < buffer + sizeof(buffer));
+    CHECK(0 == upstream.allocations);
+  }
+
+  {
+    // without a buffer, or when it runs out, blocks come from upstream and go back on release
+    monotonic_resource arena(&upstream);
+    for (int i = 0; i < 100; ++i) {
+      auto p = static_cast<char*>(arena.allocate(100 + i, 8));
+      CHECK(0 == reinterpret_cast<uintptr_t>(p) % 8);
+      p[0] = p[99 + i] = 'x';
+    }
+    CHECK(upstream.allocations > 0);
+    CHECK(upstream.allocations < 10);
+    arena.release();
+    CHECK(upstream.allocations == upstream.deallocations);
+  }
+}
+
+TEST_CASE("Test re-parsing reuses the parser's buffers") {
+  const char* line0[] = {"run", "-v", "--jobs=4", "-o", "out.txt", "in1.txt", "in2.txt", nullptr};
+  const char* line1[] = {"stop", "--force", nullptr};
+  const char* line2[] = {"list", "-a", "-b", "-c", "-o", "x", "--sort=name", "dir", nullptr};
+  const char* const* lines[] = {line0, line1, line2};
+
+  int modes[] = {argh::PREFER_FLAG_FOR_UNREG_OPTION, argh::PREFER_PARAM_FOR_UNREG_OPTION | argh::SINGLE_DASH_IS_MULTIFLAG};
+  for (int mode : modes) {
+    counting_resource counter;
+    parser cmdl(&counter);
+    cmdl.add_param("o");
+    for (auto line : lines) // let the buffers grow to fit every line
+      cmdl.parse(line, mode);
+
+    auto before = counter.allocations;
+    for (int round = 0; round < 10; ++round) {
+      for (auto line : lines)
+        cmdl.parse(line, mode);
+    }
+    CHECK(before == counter.allocations);
+    CHECK(cmdl[0] == "list");
+    CHECK(cmdl("o").str() == "x");
+  }
+
+  // a copy shares the characters, so the next parse must not overwrite them
+  parser cmdl(line0);
+  parser copy(cmdl);
+  cmdl.parse(line1);
+  CHECK(copy[0] == "run");
+  CHECK(copy("jobs").str() == "4");
+  CHECK(cmdl[0] == "stop");
+}
+
+TEST_CASE("Test schema") {
+  enum class opt { verbose, threads, output, all, list };
+  static const schema options({
+      {{"v", "--verbose"}, false},
+      {{"j", "threads"}, true},
+      {{"o", "output", "out"}, true},
+      {{"a", "all"}, false},
+      {{"l"}, false},
+  });
+  CHECK(5 == options.size());
+  CHECK(1 == options.find("threads"));
+  CHECK(1 == options.find("--j"));
+  CHECK(2 == options.find("out"));
+  CHECK(schema::npos == options.find("missing"));
+  CHECK(schema::npos == options.find("verbos"));
+
+  const char* argv[] = {"app", "--verbose", "-j", "8", "-out", "a.txt", "-o", "b.txt", "-al", "pos", nullptr};
+  for (int mode : {0, int(argh::SINGLE_DASH_IS_MULTIFLAG)}) {
+    parser cmdl(options);
+    cmdl.parse(argv, mode);
+    CHECK(cmdl[opt::verbose]);
+    CHECK(cmdl.get_or(opt::threads, 0) == 8);
+    CHECK(cmdl(opt::output).str() == "a.txt"); // the first occurrence, under any spelling
+    CHECK(!cmdl(opt::verbose));
+    CHECK(cmdl[opt::all] == (mode != 0));
+    CHECK(cmdl[opt::list] == (mode != 0));
+    CHECK(cmdl[1] == "pos");
+    // name accessors keep working on the exact spelling
+    CHECK(cmdl("j").str() == "8");
+    CHECK(cmdl["verbose"]);
+    CHECK(!cmdl["v"]);
+  }
+
+  parser unparsed(options);
+  CHECK(!unparsed[opt::verbose]);
+  CHECK(unparsed.get_or(opt::threads, -1) == -1);
+}
+
+TEST_CASE("Test schema flags do not take values under PREFER_PARAM_FOR_UNREG_OPTION") {
+  enum class opt { verbose, threads };
+  static const schema options({{{"v", "verbose"}, false}, {{"j"}, true}});
+  const char* argv[] = {"app", "-v", "file", "--unknown", "x", "-j", "8", nullptr};
+  parser cmdl(options);
+  cmdl.parse(argv, argh::PREFER_PARAM_FOR_UNREG_OPTION);
+  CHECK(cmdl[opt::verbose]);
+  CHECK(!cmdl(opt::verbose));
+  CHECK(cmdl[1] == "file");
+  CHECK(cmdl("unknown").str() == "x"); // the mode still decides for names the schema does not know
+  CHECK(cmdl.get_or(opt::threads, 0) == 8);
+  CHECK(2 == cmdl.size());
+}
+
+TEST_CASE("Test schema perfect hash over many spellings") {
+  std::vector<schema::option> list;
+  for (int i = 0; i < 500; ++i)
+    list.push_back({{"opt" + std::to_string(i), "o" + std::to_string(i), std::to_string(i) + "x"}, 0 == i % 2});
+  list.push_back({{"opt0", "fresh"}, false}); // a taken spelling stays with its first option
+  schema options(list);
+
+  for (uint32_t i = 0; i < 500; ++i) {
+    CHECK(i == options.find("opt" + std::to_string(i)));
+    CHECK(i == options.find("--o" + std::to_string(i)));
+    CHECK(i == options.find(std::to_string(i) + "x"));
+    CHECK(options.is_param(i) == (0 == i % 2));
+    CHECK(schema::npos == options.find("opt" + std::to_string(i) + "y"));
+  }
+  CHECK(0 == options.find("opt0"));
+  CHECK(500 == options.find("fresh"));
+}
+
+TEST_CASE("Test parsing a command line string") {
+  struct {
+    const char* line;
+    std::vector<std::string> words;
+  } cases[] = {
+      {"", {}},
+      {"  \t\n ", {}},
+      {"tool -v  file", {"tool", "-v", "file"}},
+      {"  lead trail  ", {"lead", "trail"}},
+      {"a 'b c' \"d e\"", {"a", "b c", "d e"}},
+      {"x'y'\"z\"w", {"xyzw"}},
+      {"'' \"\" e", {"", "", "e"}},
+      {"'a\\b' \"a\\b\" a\\b", {"a\\b", "a\\b", "ab"}},
+      {"\"q\\\"q\" \"\\$\\`\\\\\" 'it'\\''s'", {"q\"q", "$`\\", "it's"}},
+      {"a\\ b c\\\\", {"a b", "c\\"}},
+      {"one \\\n two \"th\\\nree\" fo\\\nur", {"one", "two", "three", "four"}},
+      {"'open quote", {"open quote"}},
+      {"\"open \\\"quote", {"open \"quote"}},
+      {"trailing\\", {"trailing\\"}},
+  };
+
+  for (auto& c : cases) {
+    argh::detail::vector<string_ref> args;
+    argh::detail::vector<char> buffer;
+    argh::detail::tokenize(c.line, args, buffer);
+    REQUIRE(args.size() == c.words.size());
+    for (size_t i = 0; i < args.size(); ++i) {
+      CHECK(args[i] == c.words[i]);
+      CHECK('\0' == args[i].data()[args[i].size()]);
+    }
+  }
+
+  parser cmdl({"o"});
+  cmdl.parse("tool -v --name='a b' -o \"out dir\" --empty= '' file\\ one");
+  CHECK(cmdl.size() == 3);
+  CHECK(cmdl[0] == "tool");
+  CHECK(cmdl[1] == "");
+  CHECK(cmdl[2] == "file one");
+  CHECK(cmdl["v"]);
+  CHECK(cmdl("name").str() == "a b");
+  CHECK(cmdl("o").str() == "out dir");
+  CHECK(cmdl("empty"));
+
+  std::string line = "again -x 1";
+  cmdl.parse(line, argh::PREFER_PARAM_FOR_UNREG_OPTION);
+  line.clear(); // the parser has its own copy
+  CHECK(cmdl[0] == "again");
+  CHECK(cmdl.get_or("x", 0) == 1);
+}
+
+TEST_CASE("Test tokenize scanners match the scalar reference") {
+  using argh::detail::scanner;
+  std::vector<std::string> lines;
+  const char alphabet[] = "ab  \t\n\r'\"\\$`=-x\0";
+  unsigned seed = 12345;
+  auto next = [&seed] { return seed = seed * 1103515245u + 12345u, seed >> 16; };
+  for (int i = 0; i < 20000; ++i) {
+    std::string line;
+    auto length = next() % 120;
+    for (size_t k = 0; k < length; ++k) {
+      if (0 == next() % 8) // long runs, to cross 16 and 32 byte blocks
+        line.append(next() % 70, "word"[k % 4]);
+      else
+        line += alphabet[next() % (sizeof(alphabet) - 1)];
+    }
+    lines.push_back(line);
+  }
+  lines.push_back(std::string(1000, 'x') + " \"" + std::string(1000, 'y') + "\\\"" + std::string(33, 'z') + "\" end");
+
+  for (auto& line : lines) {
+    argh::detail::vector<string_ref> expected;
+    argh::detail::vector<char> expected_buffer;
+    argh::detail::tokenize(line, expected, expected_buffer, scanner::scalar);
+
+    for (auto scan : {scanner::sse2, scanner::avx2}) {
+      argh::detail::vector<string_ref> args;
+      argh::detail::vector<char> buffer;
+      argh::detail::tokenize(line, args, buffer, scan);
+      REQUIRE(args.size() == expected.size());
+      for (size_t i = 0; i < args.size(); ++i)
+        CHECK(args[i] == expected[i]);
+    }
+  }
+}
+
+namespace {
+void write_file(const char* path, std::string const& contents) {
+  auto file = std::fopen(path, "wb");
+  REQUIRE(file);
+  std::fwrite(contents.data(), 1, contents.size(), file);
+  std::fclose(file);
+}
+} // namespace
+
+TEST_CASE("Test response files") {
+  write_file("argh_outer.rsp", "-v --name='a b'\n@argh_inner.rsp \"quoted word\" @argh_missing.rsp");
+  write_file("argh_inner.rsp", "-o out.txt @argh_cycle.rsp");
+  write_file("argh_cycle.rsp", "--deep=1 @argh_outer.rsp");
+  write_file("argh_empty.rsp", "");
+
+  const char* argv[] = {"@prog", "first", "@argh_outer.rsp", "@argh_empty.rsp", "last", "@", nullptr};
+  for (int mode : {int(argh::EXPAND_RESPONSE_FILES), argh::EXPAND_RESPONSE_FILES | argh::NO_COPY_ARGV}) {
+    parser cmdl({"o"});
+    cmdl.parse(argv, mode);
+    std::vector<std::string> pos;
+    for (size_t i = 0; i < cmdl.size(); ++i)
+      pos.push_back(cmdl[i]);
+    // the program name is never expanded, and neither is a file being expanded already
+    CHECK(pos == std::vector<std::string>{"@prog", "first", "@argh_outer.rsp", "quoted word", "@argh_missing.rsp", "last", "@"});
+    CHECK(cmdl["v"]);
+    CHECK(cmdl("name").str() == "a b");
+    CHECK(cmdl("o").str() == "out.txt");
+    CHECK(cmdl.get_or("deep", 0) == 1);
+
+    parser copy(cmdl);
+    cmdl.parse("tool @argh_inner.rsp", mode);
+    CHECK(cmdl("o").str() == "out.txt");
+    CHECK(copy("name").str() == "a b"); // the copy keeps the files it refers to
+  }
+
+  parser plain(argv);
+  CHECK(plain[2] == "@argh_outer.rsp");
+  CHECK(!plain["v"]);
+
+  for (auto path : {"argh_outer.rsp", "argh_inner.rsp", "argh_cycle.rsp", "argh_empty.rsp"})
+    std::remove(path);
+}
+
+TEST_CASE("Test parsing a NUL delimited command line") {
+  const char buffer[] = "app\0-v\0--n=1\0\0pos\0-o\0last";
+  for (int mode : {0, int(argh::NO_COPY_ARGV)}) {
+    parser cmdl;
+    cmdl.parse_nul_delimited(buffer, sizeof(buffer) - 1, mode);
+    CHECK(cmdl.size() == 4);
+    CHECK(cmdl[0] == "app");
+    CHECK(cmdl[1] == ""); // an empty arg
+    CHECK(cmdl[2] == "pos");
+    CHECK(cmdl[3] == "last");
+    CHECK(cmdl["v"]);
+    CHECK(cmdl.get_or("n", 0) == 1);
+    CHECK(cmdl["o"]);
+    CHECK((cmdl.pos_view(0).data() == buffer) == (mode != 0));
+  }
+
+  // a trailing NUL does not start another arg
+  parser cmdl;
+  cmdl.parse_nul_delimited(buffer, sizeof(buffer), argh::PREFER_PARAM_FOR_UNREG_OPTION);
+  CHECK(cmdl("o").str() == "last");
+  CHECK(cmdl.size() == 3);
+
+  write_file("argh_cmdline", std::string("tool\0--jobs=2\0input", 20));
+  CHECK(cmdl.parse_cmdline_file("argh_cmdline"));
+  CHECK(cmdl[0] == "tool");
+  CHECK(cmdl[1] == "input");
+  CHECK(cmdl.get_or("jobs", 0) == 2);
+  std::remove("argh_cmdline");
+
+  CHECK(!cmdl.parse_cmdline_file("argh_no_such_file"));
+  CHECK(0 == cmdl.size());
+  CHECK(!cmdl["jobs"]);
+
+  std::FILE* proc = std::fopen("/proc/self/cmdline", "rb");
+  if (proc) {
+    std::string contents;
+    char chunk[4096];
+    size_t count;
+    while ((count = std::fread(chunk, 1, sizeof(chunk), proc)) > 0)
+      contents.append(chunk, count);
+    std::fclose(proc);
+
+    // whatever the binary is called, or however it was run, both read the same records
+    parser self;
+    CHECK(self.parse_self_cmdline());
+    parser expected;
+    expected.parse_nul_delimited(contents.data(), contents.size());
+    CHECK(self[0] == contents.substr(0, contents.find('\0')));
+    CHECK(self.size() == expected.size());
+    for (size_t i = 0; i < expected.size(); ++i)
+      CHECK(self[i] == expected[i]);
+  }
+}
+
+TEST_CASE("Test lazy parsing matches eager parsing") {
+  const char* argv[] = {"app", "-v", "--n=1", "-o", "out", "pos", "-abc", "--", "-x", "-5", nullptr};
+  for (int mode : {0, int(argh::PREFER_FLAG_FOR_UNREG_OPTION), int(argh::PREFER_PARAM_FOR_UNREG_OPTION),
+                   int(argh::SINGLE_DASH_IS_MULTIFLAG), int(argh::NO_COPY_ARGV)}) {
+    parser eager({"o"});
+    eager.parse(argv, mode);
+    parser lazy({"o"});
+    lazy.parse(argv, mode | argh::LAZY);
+
+    REQUIRE(lazy.size() == eager.size());
+    for (size_t i = 0; i < eager.size(); ++i)
+      CHECK(lazy[i] == eager[i]);
+    for (auto name : {"v", "n", "o", "a", "abc", "x", "missing"}) {
+      CHECK(lazy[name] == eager[name]);
+      CHECK(lazy(name).str() == eager(name).str());
+    }
+  }
+
+  // a param registered after a lazy parse does not change its results
+  parser late;
+  late.parse(argv, argh::LAZY);
+  late.add_param("o");
+  CHECK(late["o"]);
+  CHECK(late[1] == "out");
+
+  // an eager parse replaces a pending lazy one
+  late.parse(argv, argh::LAZY);
+  late.parse(argv);
+  CHECK(late("o").str() == "out");
+
+  // copies classify the source first, and carry the results
+  parser source({"o"});
+  source.parse(argv, argh::LAZY);
+  parser copy(source);
+  CHECK(copy("o").str() == "out");
+  source.parse(argv, argh::LAZY);
+  copy = source;
+  CHECK(copy("n").str() == "1");
+  CHECK(source("n").str() == "1");
+}
+
+TEST_CASE("Test concurrent first access to a lazy parser") {
+  const char* argv[] = {"app", "-v", "--n=42", "-o", "out", "pos", nullptr};
+  for (int round = 0; round < 20; ++round) {
+    parser cmdl({"o"});
+    cmdl.parse(argv, argh::LAZY);
+    const parser& shared = cmdl;
+
+    std::vector<int> ok(4, 0);
+    std::vector<std::string const*> pos(4, nullptr);
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < ok.size(); ++t)
+      pool.emplace_back([&shared, &ok, &pos, t] {
+        int n = 0;
+        ok[t] = shared["v"] && (shared("n") >> n) && 42 == n && shared(1).str() == "pos" && shared.size() == 2;
+        pos[t] = &shared[1];
+      });
+    for (auto& worker : pool)
+      worker.join();
+    CHECK(std::vector<int>(4, 1) == ok);
+    // a single string is built, whichever thread asks first
+    CHECK(std::vector<std::string const*>(4, &shared[1]) == pos);
+    CHECK(shared[1] == "pos");
+  }
+}
+
+TEST_CASE("Test stopping at -- and at the first positional") {
+  const char* argv[] = {"app", "-v", "--n=1", "--", "-x", "--", "@f", nullptr};
+
+  // by default, "--" is just an option with no name
+  parser plain(argv);
+  CHECK(plain["x"]);
+  CHECK(plain.tail().empty());
+
+  for (int mode : {0, int(argh::NO_COPY_ARGV), int(argh::LAZY)}) {
+    parser cmdl;
+    cmdl.parse(argv, mode | argh::STOP_AT_DOUBLE_DASH);
+    CHECK(cmdl["v"]);
+    CHECK(cmdl("n").str() == "1");
+    CHECK(!cmdl["x"]);
+    CHECK(!cmdl[""]);
+    CHECK(cmdl.size() == 1);
+    auto tail = cmdl.tail();
+    REQUIRE(tail.size() == 3);
+    CHECK(tail[0] == "-x");
+    CHECK(tail[1] == "--");
+    CHECK(tail[2] == "@f");
+    CHECK((tail[0].data() == argv[4]) == (mode == argh::NO_COPY_ARGV));
+    std::vector<std::string> words(tail.begin(), tail.end());
+    CHECK(words == std::vector<std::string>{"-x", "--", "@f"});
+  }
+
+  // a trailing "--" leaves an empty tail
+  const char* trailing[] = {"app", "-v", "--", nullptr};
+  parser cmdl(trailing, argh::STOP_AT_DOUBLE_DASH);
+  CHECK(cmdl["v"]);
+  CHECK(cmdl.tail().empty());
+
+  // subcommand style: options before the subcommand belong to the tool, the rest to the subcommand
+  const char* sub[] = {"git", "--no-pager", "-C", "dir", "commit", "-m", "msg", "--", "file", nullptr};
+  parser tool({"C"});
+  tool.parse(sub, argh::STOP_AT_FIRST_POSITIONAL);
+  CHECK(tool["no-pager"]);
+  CHECK(tool("C").str() == "dir");
+  CHECK(!tool["m"]);
+  REQUIRE(tool.size() == 2);
+  CHECK(tool[1] == "commit");
+  REQUIRE(tool.tail().size() == 4);
+  CHECK(tool.tail()[0] == "-m");
+
+  // whichever comes first stops parsing
+  tool.parse(sub, argh::STOP_AT_FIRST_POSITIONAL | argh::STOP_AT_DOUBLE_DASH);
+  CHECK(tool[1] == "commit");
+  tool.parse(sub + 4, argh::STOP_AT_FIRST_POSITIONAL | argh::STOP_AT_DOUBLE_DASH);
+  CHECK(tool[0] == "commit");
+  CHECK(tool["m"]);
+  CHECK(tool.size() == 2);
+  CHECK(tool[1] == "msg");
+  REQUIRE(tool.tail().size() == 2);
+  CHECK(tool.tail()[0] == "--");
+  tool.parse(sub + 4, argh::STOP_AT_DOUBLE_DASH);
+  CHECK(tool.size() == 2);
+  CHECK(tool.tail()[0] == "file");
+}
+
+TEST_CASE("Test routing subcommands") {
+  argh::router tool({{"remote add", {"t"}},
+                     {"remote", {}},
+                     {"commit", {"m", "message"}},
+                     {"remote  remove", {}},
+                     {"commit", {"ignored"}}});
+  CHECK(tool.size() == 5);
+
+  const char* commit[] = {"git", "commit", "-m", "fix", "-a", nullptr};
+  CHECK(tool.route(commit) == 2);
+  CHECK(tool[2][0] == "commit");
+  CHECK(tool[2]("m").str() == "fix");
+  CHECK(tool[2]["a"]);
+  CHECK(tool[2].size() == 1);
+
+  // the longest path wins, and each subcommand has its own params
+  const char* add[] = {"git", "remote", "add", "-t", "main", "origin", "url", nullptr};
+  CHECK(tool.route(add, argh::NO_COPY_ARGV) == 0);
+  CHECK(tool[0].pos_view(0).data() == add[2]);
+  CHECK(tool[0]("t").str() == "main");
+  CHECK(tool[0][1] == "origin");
+  CHECK(tool[0][2] == "url");
+
+  const char* remote[] = {"git", "remote", "-v", "show", nullptr};
+  CHECK(tool.route(remote) == 1);
+  CHECK(tool[1]["v"]);
+  CHECK(tool[1][1] == "show");
+  CHECK(!tool[1]("t"));
+
+  const char* remove[] = {"git", "remote", "remove", "origin", nullptr};
+  argh::router copy(tool);
+  CHECK(copy.route(remove) == 3);
+  CHECK(copy[3][1] == "origin");
+
+  // no match leaves the parsers as they were
+  const char* unknown[] = {"git", "push", nullptr};
+  const char* prefix[] = {"git", "rem", nullptr};
+  const char* none[] = {"git", nullptr};
+  CHECK(tool.route(unknown) == argh::router::npos);
+  CHECK(tool.route(prefix) == argh::router::npos);
+  CHECK(tool.route(none) == argh::router::npos);
+  CHECK(tool[2]("m").str() == "fix");
+
+  // an empty path catches the rest
+  argh::router fallback({{"", {"o"}}, {"run", {}}});
+  CHECK(fallback.route(unknown) == 0);
+  CHECK(fallback[0][0] == "git");
+  CHECK(fallback[0][1] == "push");
+  const char* run[] = {"tool", "run", "-o", "x", nullptr};
+  CHECK(fallback.route(run) == 1);
+  CHECK(fallback[1][1] == "x");
+}
+
+TEST_CASE("Test abbreviated options") {
+  const char* argv[] = {"app", "--verb", "--col=auto", "--conf", "x", "--co", "--c", "-ve", "--verbose-l", "3", nullptr};
+  parser cmdl({"verbose", "verbose-level", "color", "config"});
+  cmdl.parse(argv, argh::ALLOW_ABBREVIATIONS);
+
+  CHECK(cmdl("color").str() == "auto");
+  CHECK(cmdl("config").str() == "x");
+  CHECK(cmdl("verbose-level").str() == "3");
+  CHECK(cmdl.size() == 1);
+
+  // the results hold the full names, and the accessors take only those
+  CHECK(!cmdl("conf"));
+  CHECK(!cmdl("verbose-l"));
+  CHECK(!cmdl["verbose-l"]);
+
+  // ambiguous prefixes are kept as typed, and reported
+  CHECK(cmdl["verb"]);
+  CHECK(cmdl["co"]);
+  CHECK(!cmdl("verbose"));
+  std::vector<std::string> ambiguous(cmdl.ambiguous().begin(), cmdl.ambiguous().end());
+  CHECK(ambiguous == std::vector<std::string>{"verb", "co"});
+
+  // a single character is too short to abbreviate anything, and an empty name is never expanded
+  CHECK(cmdl["c"]);
+  const char* short_names[] = {"app", "--x", "--=foo", "--xml", nullptr};
+  parser xml({"width"});
+  xml.parse(short_names, argh::ALLOW_ABBREVIATIONS);
+  CHECK(xml["x"]);
+  CHECK(xml("").str() == "foo");
+  CHECK(!xml("width"));
+  CHECK(xml.ambiguous().empty());
+  const char* only_xml[] = {"app", "--xml", nullptr};
+  xml.parse(only_xml, argh::ALLOW_ABBREVIATIONS);
+  CHECK(xml["xml"]);
+  CHECK(!xml["x"]);
+  CHECK(!xml[""]);
+
+  // single dash options are not abbreviated
+  CHECK(cmdl["ve"]);
+
+  // a name that is known wins over the longer ones it is a prefix of
+  const char* exact[] = {"app", "--verbose", "1", nullptr};
+  cmdl.parse(exact, argh::ALLOW_ABBREVIATIONS);
+  CHECK(cmdl("verbose").str() == "1");
+  CHECK(!cmdl("verbose-level"));
+  CHECK(cmdl.ambiguous().empty());
+
+  // without the mode, nothing changes
+  cmdl.parse(argv);
+  CHECK(cmdl["conf"]);
+  CHECK(!cmdl("config"));
+  CHECK(!cmdl("color"));
+  CHECK(cmdl.ambiguous().empty());
+
+  // params registered after a parse are picked up by the next one
+  cmdl.add_param("width");
+  const char* wide[] = {"app", "--wid", "80", nullptr};
+  cmdl.parse(wide, argh::ALLOW_ABBREVIATIONS | argh::LAZY);
+  CHECK(cmdl("width").str() == "80");
+
+  // the spellings of one schema option do not make a prefix ambiguous
+  enum class opt { verbose, version };
+  argh::schema options({{{"verbose", "verbosity"}, false}, {{"version"}, false}});
+  parser with_schema(options);
+  const char* flags[] = {"app", "--verbo", "--vers", "--ver", nullptr};
+  with_schema.parse(flags, argh::ALLOW_ABBREVIATIONS);
+  CHECK(with_schema[opt::verbose]);
+  CHECK(with_schema[opt::version]);
+  CHECK(with_schema["ver"]);
+  REQUIRE(with_schema.ambiguous().size() == 1);
+  CHECK(with_schema.ambiguous()[0] == "ver");
+}
+
+TEST_CASE("Test abbreviations come from the parser's memory resource") {
+  const char* argv[] = {"app", "--verb", "--col=auto", "--co", nullptr};
+  counting_resource counter;
+  {
+    parser cmdl(&counter);
+    cmdl.add_params(std::vector<std::string>{"verbose", "color", "config"});
+    // counter takes its memory from ::operator new: any other heap allocation went around it
+    auto global = global_allocations.load();
+    auto allocations = counter.allocations;
+    cmdl.parse(argv, argh::ALLOW_ABBREVIATIONS);
+    CHECK(allocations < counter.allocations);
+    CHECK(global_allocations.load() - global == counter.allocations - allocations);
+    CHECK(cmdl["verbose"]);
+    CHECK(cmdl.get_or("color", string_ref()) == "auto");
+    CHECK(cmdl.ambiguous().size() == 1);
+  }
+  CHECK(counter.allocations == counter.deallocations);
+}
+
+TEST_CASE("Test registering many params at once") {
+  std::vector<std::string> names;
+  for (int i = 0; i < 100000; ++i)
+    names.push_back((i % 2 ? "--p" : "p") + std::to_string(i));
+  names.push_back("p7"); // a duplicate
+
+  parser cmdl(names);
+  cmdl.add_params(std::vector<std::string>{"-extra"});
+  const char* argv[] = {"app", "--p7", "a", "-p99999", "b", "--extra", "c", "--unknown", "d", nullptr};
+  cmdl.parse(argv);
+  CHECK(cmdl("p7").str() == "a");
+  CHECK(cmdl("p99999").str() == "b");
+  CHECK(cmdl("extra").str() == "c");
+  CHECK(cmdl["unknown"]);
+  CHECK(cmdl.size() == 2);
+
+  batch_parser batch(names);
+  batch.parse({argv});
+  CHECK(batch[0]("p99999").str() == "b");
+  CHECK(batch[0]["unknown"]);
+}
+
+TEST_CASE("Test single character flags") {
+  const char* argv[] = {"app", "-xvvf", "-v", "--verbose", "-abco", "out", "-\xff", nullptr};
+  parser cmdl({"o"});
+  cmdl.parse(argv, argh::SINGLE_DASH_IS_MULTIFLAG);
+  CHECK(cmdl["x"]);
+  CHECK(cmdl["-v"]);
+  CHECK(cmdl["f"]);
+  CHECK(cmdl["verbose"]);
+  CHECK(cmdl["a"]);
+  CHECK(cmdl["\xff"]);
+  CHECK(!cmdl["o"]);
+  CHECK(!cmdl["z"]);
+  CHECK(cmdl("o").str() == "out"); // the last char is a registered param
+  CHECK(cmdl.count('v') == 3);
+  CHECK(cmdl.count('x') == 1);
+  CHECK(cmdl.count('\xff') == 1);
+  CHECK(cmdl.count('o') == 0);
+
+  // a re-parse starts from scratch
+  const char* again[] = {"app", "-x", nullptr};
+  cmdl.parse(again, argh::SINGLE_DASH_IS_MULTIFLAG);
+  CHECK(cmdl["x"]);
+  CHECK(!cmdl["v"]);
+  CHECK(cmdl.count('v') == 0);
+  CHECK(cmdl.count('x') == 1);
+
+  // without multi-flags, only whole single character options count
+  cmdl.parse(argv);
+  CHECK(cmdl["v"]);
+  CHECK(!cmdl["x"]);
+  CHECK(cmdl["xvvf"]);
+  CHECK(cmdl.count('v') == 1);
+}
+
+TEST_CASE("Test long command lines classify across blocks") {
+  std::vector<std::string> words{"app"};
+  for (int i = 0; i < 1000; ++i) {
+    words.push_back(i % 7 ? "-o" : "--o=x");
+    words.push_back(i % 5 ? "v" + std::to_string(i) : "-5");
+  }
+  std::vector<const char*> argv;
+  for (auto& word : words)
+    argv.push_back(word.c_str());
+  argv.push_back(nullptr);
+
+  parser registered({"o"});
+  registered.parse(argv.data());
+  CHECK(registered.size() == 1 + 143); // the values after each "--o=x"
+  CHECK(registered("o").str() == "x");
+
+  parser unregistered;
+  unregistered.parse(argv.data());
+  CHECK(unregistered.size() == 1 + 1000);
+  CHECK(unregistered[1000] == "v999");
+  CHECK(unregistered[3] == "v2");
+}
+
+TEST_CASE("Test option handles") {
+  const char* argv[] = {"app", "-v", "--n=5", "--name", "x", nullptr};
+  parser cmdl({"name"});
+  cmdl.parse(argv);
+
+  auto v = cmdl.handle("v");
+  auto n = cmdl.handle("--n");
+  auto name = cmdl.handle("name");
+  auto missing = cmdl.handle("missing");
+  CHECK(cmdl[v]);
+  CHECK(!cmdl[n]);
+  CHECK(cmdl(n).str() == "5");
+  CHECK(cmdl.get_or(n, 0) == 5);
+  CHECK(cmdl(name).str() == "x");
+  CHECK(!cmdl[missing]);
+  CHECK(!cmdl(missing));
+  CHECK(cmdl.get_or(missing, 7) == 7);
+  CHECK(name.name() == "name");
+
+  // after a re-parse, old handles still answer for the new parse
+  const char* other[] = {"app", "--missing", "--n=6", nullptr};
+  cmdl.parse(other);
+  CHECK(!cmdl[v]);
+  CHECK(cmdl[missing]);
+  CHECK(cmdl.get_or(n, 0) == 6);
+  CHECK(!cmdl(name));
+
+  // and so do handles of another parser, or of a copy
+  parser copy(cmdl);
+  auto copied = cmdl.handle("n");
+  CHECK(copy.get_or(copied, 0) == 6);
+  parser first(argv);
+  CHECK(first[v]);
+  CHECK(!first[missing]);
+  CHECK(!first[copied]);
+
+  // lazy parsers classify on the first handle
+  parser lazy;
+  lazy.parse(argv, argh::LAZY);
+  auto lazy_v = lazy.handle("v");
+  CHECK(lazy[lazy_v]);
+
+  // a default handle finds nothing
+  CHECK(!cmdl[argh::option_handle()]);
+}
+
+TEST_CASE("Test compile time option names") {
+  using namespace argh::literals;
+  static_assert(("--threads"_opt).hash() == argh::detail::constexpr_hash("threads", 7), "hashed at compile time");
+  static_assert(("--threads"_opt).name().size() == 7, "dashes stripped at compile time");
+  static_assert(("--"_opt).name().size() == 2, "a name of only dashes is kept");
+  CHECK(("-v"_opt).hash() == argh::detail::hash("v"));
+  CHECK(("---long-name"_opt).hash() == argh::detail::hash("long-name"));
+
+  const char* argv[] = {"app", "-v", "--threads=4", "--name", "x", "-abc", nullptr};
+  parser cmdl({"name"});
+  cmdl.parse(argv, argh::SINGLE_DASH_IS_MULTIFLAG);
+  CHECK(cmdl["-v"_opt]);
+  CHECK(cmdl["b"_opt]);
+  CHECK(!cmdl["--verbose"_opt]);
+  CHECK(cmdl("--threads"_opt).str() == "4");
+  CHECK(cmdl.get_or("threads"_opt, 0) == 4);
+  CHECK(cmdl.get_or("missing"_opt, 9) == 9);
+  CHECK(cmdl("name"_opt).str() == "x");
+  CHECK(!cmdl("v"_opt));
+
+  constexpr argh::option_name threads("--threads");
+  CHECK(cmdl.get_or(threads, 0) == 4);
+  CHECK(cmdl[cmdl.handle("-v"_opt)]);
+
+  // literals take full names, like the other accessors
+  cmdl.parse(argv, argh::ALLOW_ABBREVIATIONS);
+  CHECK(cmdl("name"_opt).str() == "x");
+  CHECK(!cmdl("na"_opt));
+}
+
+TEST_CASE("Test lookups by literal or view do not allocate") {
+  const char* argv[] = {"app", "--a-rather-long-flag-name", "--a-rather-long-param-name=42", "pos", nullptr};
+  counting_resource counter;
+  parser cmdl(&counter);
+  cmdl.parse(argv);
+  const std::string flag = "--a-rather-long-flag-name";
+  const string_ref param("a-rather-long-param-name");
+
+  auto before = global_allocations.load();
+  auto resource_before = counter.allocations;
+  bool found = cmdl["a-rather-long-flag-name"] && cmdl[flag] && !cmdl["a-rather-long-missing-name"];
+  found = found && cmdl[{"a-rather-long-missing-name", "a-rather-long-flag-name"}];
+  found = found && cmdl.view("a-rather-long-param-name") && cmdl.view(param) && !cmdl.view("a-rather-long-missing-name");
+  found = found && cmdl.view({"--a-rather-long-missing-name", param});
+  int value = 0;
+  found = found && cmdl.get(param, value) && 42 == value;
+  found = found && cmdl.get_or({"a-rather-long-missing-name", "a-rather-long-param-name"}, 0) == 42;
+  auto after = global_allocations.load();
+
+  CHECK(found);
+  CHECK(before == after);
+  CHECK(resource_before == counter.allocations);
+}
+
+TEST_CASE("Test alias groups") {
+  const char* argv[] = {"app", "--nice", "5", "-q", "--level=2", "-n", "7", "file", nullptr};
+  parser cmdl({"n", "nice", "level", "l"});
+  cmdl.add_aliases({"-n", "--nice"});
+  cmdl.add_aliases({"-q", "--quiet", "--silent"});
+  cmdl.add_aliases({"--level", "-l"});
+  cmdl.parse(argv);
+
+  // the first occurrence under any spelling wins
+  CHECK(cmdl("n").str() == "5");
+  CHECK(cmdl("--nice").str() == "5");
+  CHECK(cmdl.get_or("-l", 0) == 2);
+  CHECK(cmdl["quiet"]);
+  CHECK(cmdl["--silent"]);
+  CHECK(cmdl["q"]);
+  CHECK(!cmdl["nice"]);
+  CHECK(cmdl[0] == "app");
+  CHECK(cmdl[1] == "file");
+
+  using namespace argh::literals;
+  CHECK(cmdl["--silent"_opt]);
+  CHECK(cmdl("-l"_opt).str() == "2");
+  CHECK(cmdl[cmdl.handle("quiet")]);
+
+  // a spelling keeps its first group
+  cmdl.add_aliases({"-n", "--renice"});
+  CHECK(!cmdl("renice"));
+  CHECK(cmdl("n").str() == "5");
+
+  // aliases apply to the current parse, and survive a re-parse and a copy
+  cmdl.add_aliases({"v", "verbose"});
+  CHECK(!cmdl["v"]);
+  cmdl.add_aliases({"--loud", "q"});
+  CHECK(!cmdl["loud"]);
+  const char* again[] = {"app", "--verbose", nullptr};
+  cmdl.parse(again);
+  parser copy(cmdl);
+  CHECK(copy["v"]);
+  CHECK(!copy["quiet"]);
+
+  // handles resolved before an alias is added agree with name lookups
+  const char* quiet[] = {"app", "--hush", "--mute=1", nullptr};
+  parser later(quiet);
+  auto hush = later.handle("shh");
+  auto mute = later.handle("m");
+  CHECK(!later[hush]);
+  CHECK(!later(mute));
+  later.add_aliases({"shh", "hush"});
+  later.add_aliases({"m", "mute"});
+  CHECK(later["shh"]);
+  CHECK(later[hush]);
+  CHECK(later(mute).str() == "1");
+
+  // a param takes a separate value under every spelling, whichever of add_param and add_aliases comes first
+  const char* nice[] = {"app", "--nice", "5", "--sleep", "1", nullptr};
+  parser param_first;
+  param_first.add_param("n");
+  param_first.add_aliases({"-n", "--nice"});
+  parser aliases_first;
+  aliases_first.add_aliases({"--sleep", "-s"});
+  aliases_first.add_params(std::vector<std::string>{"-s"});
+  for (parser* p : {&param_first, &aliases_first}) {
+    p->parse(nice);
+    CHECK(p->size() == 2);
+  }
+  CHECK(param_first("n").str() == "5");
+  CHECK(param_first["sleep"]);
+  CHECK(param_first[1] == "1");
+  CHECK(aliases_first["nice"]);
+  CHECK(aliases_first[1] == "5");
+  CHECK(aliases_first("s").str() == "1");
+
+  // single character flags in a group
+  cmdl.parse(argv, argh::SINGLE_DASH_IS_MULTIFLAG);
+  CHECK(cmdl["silent"]);
+  CHECK(2 == cmdl.get_or("level", 0));
+}
+
+TEST_CASE("Test streams outlive their parser unless they are views") {
+  std::vector<std::string> words = {"app", "--name=a-value-longer-than-any-small-string-buffer", "pos"};
+  std::vector<const char*> argv;
+  for (auto& word : words)
+    argv.push_back(word.c_str());
+  argv.push_back(nullptr);
+
+  string_stream name, pos;
+  {
+    parser cmdl(argv.data());
+    name = cmdl("name");
+    pos = cmdl(1);
+    CHECK(cmdl.view("name").str() == "a-value-longer-than-any-small-string-buffer");
+    CHECK(cmdl.view(1).str() == "pos");
+    CHECK(!cmdl.view("missing"));
+    CHECK(cmdl.view({"n", "name"}).str() == "a-value-longer-than-any-small-string-buffer");
+
+    // a re-parse does not touch the owned copies
+    const char* other[] = {"app", "--name=other", nullptr};
+    cmdl.parse(other);
+  }
+  CHECK(name.str() == "a-value-longer-than-any-small-string-buffer");
+  CHECK(pos.str() == "pos");
+}
+
+TEST_CASE("Test positional args are returned as strings") {
+  const char* argv[] = {"app", "-v", "input", nullptr};
+  parser cmdl(argv, argh::NO_COPY_ARGV);
+  CHECK(std::string(cmdl[1].c_str()) == "input");
+  CHECK(cmdl[1] + ".txt" == "input.txt");
+  CHECK(cmdl[5].empty());
+  CHECK(cmdl.pos_view(1).data() == argv[2]);
+  CHECK(cmdl.pos_view(5).empty());
+}